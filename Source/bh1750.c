@@ -14,30 +14,126 @@
 
 uint8 bh1750_MTreg = (uint8)BH1750_DEFAULT_MTREG;
 uint8 bh1750_mode = CONTINUOUS_HIGH_RES_MODE;
+static uint16 bh1750_scaleQ12 = BH1750_SCALE_Q12(BH1750_DEFAULT_MTREG); // lux per count, follows bh1750_MTreg
 
 /**
- * Configure BH1750 with specified mode
- * @param mode Measurement mode
+ * Auto ranging, darkest range first. A range is left upwards when the
+ * reading reaches upperLux and downwards when it drops below
+ * BH1750_RANGE_DOWN of the lower range's upperLux.
+ * Resolution and full scale at the given MTreg, DS p.11:
  */
-bool bh1750_init(uint8 mode) {
-  bh1850_Write(BH1750_RESET);
-  bh1850_Write(BH1750_POWER_ON);
+static const struct {
+  uint8 mode;
+  uint8 MTreg;
+  uint16 upperLux;
+} bh1750_ranges[] = {
+  {ONE_TIME_HIGH_RES_MODE_2, 254, 10},                 // 0.14 lx, 7417 lx, 663 ms
+  {ONE_TIME_HIGH_RES_MODE, BH1750_DEFAULT_MTREG, 1000}, // 1 lx, 54612 lx, 180 ms
+  {ONE_TIME_LOW_RES_MODE, BH1750_DEFAULT_MTREG, 10000}, // 4 lx, 54612 lx, 24 ms
+  {ONE_TIME_LOW_RES_MODE, 32, 0xFFFF}                   // 8.6 lx, 100 klx, 12 ms
+};
+
+#define BH1750_RANGES_COUNT (sizeof(bh1750_ranges) / sizeof(bh1750_ranges[0]))
+#define BH1750_RANGE_DEFAULT 1
+#define BH1750_RANGE_DOWN(lux) ((lux) - ((lux) >> 2)) // 25% hysteresis
+
+// max measurement time at BH1750_DEFAULT_MTREG, DS p.2
+#define BH1750_H_RES_TIME_MS 180
+#define BH1750_L_RES_TIME_MS 24
+
+static uint8 bh1750_range = BH1750_RANGE_DEFAULT;
+
+static int8 bh1750_readCount(uint16 *count);
+static int8 bh1850_WriteSequence(const uint8 *cmds, uint8 count);
+
+/**
+ * Start the presence check, a low resolution one time measurement.
+ * Call bh1750_finishProbe at least BH1750_PROBE_TIME_MS later
+ */
+void bh1750_startProbe(void) {
+  static const uint8 cmds[] = {BH1750_RESET, BH1750_POWER_ON, ONE_TIME_LOW_RES_MODE};
   
-  bh1850_Write(ONE_TIME_LOW_RES_MODE);
-  bh1750_WaitMs(24);
-  if((uint16)(bh1850_Read() *100) == 0){
-    return 0;
+  if (bh1850_WriteSequence(cmds, sizeof(cmds)) == I2C_SUCCESS) {
+    bh1750_mode = ONE_TIME_LOW_RES_MODE;
   }
+}
+
+/**
+ * Check the probe measurement, auto ranging starts from the default range
+ * @return bool true if the sensor answered
+ */
+bool bh1750_finishProbe(void) {
+  uint16 count;
   
-  bh1750_mode = mode;
-  bh1850_Write(mode);
-  bh1750_setMTreg(bh1750_MTreg);
+  // the sensor acks its address even if it is completely dark
+  if (bh1750_readCount(&count) != I2C_SUCCESS) {
+    return 0;
+  }
   
-  bh1850_PowerDown();
+  // one time measurement is over, the sensor is powered down by now
+  bh1750_range = BH1750_RANGE_DEFAULT;
   
   return 1;
 }
 
+/**
+ * Start a one time measurement in the currently selected range,
+ * the result can be read after bh1750_measurementTimeMs
+ */
+void bh1750_startMeasurement(void) {
+  uint8 cmds[4];
+  uint8 count = 0;
+  uint8 MTreg = bh1750_ranges[bh1750_range].MTreg;
+  
+  // power on, MTreg and mode in one bus session
+  cmds[count++] = BH1750_POWER_ON;
+  if (bh1750_MTreg != MTreg) {
+    cmds[count++] = BH1750_MTREG_HIGH(MTreg);
+    cmds[count++] = BH1750_MTREG_LOW(MTreg);
+  }
+  cmds[count++] = bh1750_ranges[bh1750_range].mode;
+  if (bh1850_WriteSequence(cmds, count) != I2C_SUCCESS) {
+    // the sensor kept its old MTreg, so does the cache
+    return;
+  }
+  bh1750_MTreg = MTreg;
+  bh1750_scaleQ12 = BH1750_SCALE_Q12(MTreg);
+  bh1750_mode = bh1750_ranges[bh1750_range].mode;
+  LREP("[BH1750] mode %d MTreg %d\r\n", bh1750_mode, bh1750_MTreg);
+}
+
+/**
+ * Max time of a measurement with the current mode and MTreg
+ * @return uint16 time in ms, rounded up
+ */
+uint16 bh1750_measurementTimeMs(void) {
+  uint16 time = BH1750_H_RES_TIME_MS;
+  
+  if (bh1750_mode == ONE_TIME_LOW_RES_MODE || bh1750_mode == CONTINUOUS_LOW_RES_MODE) {
+    time = BH1750_L_RES_TIME_MS;
+  }
+  return (uint16)(((uint32)time * bh1750_MTreg + BH1750_DEFAULT_MTREG - 1) / BH1750_DEFAULT_MTREG);
+}
+
+/**
+ * Pick the range for the next measurement from the last reading
+ * @param lux last reading
+ */
+void bh1750_autoRange(uint16 lux) {
+  uint8 range = bh1750_range;
+  
+  while (range + 1 < BH1750_RANGES_COUNT && lux >= bh1750_ranges[range].upperLux) {
+    range++;
+  }
+  while (range > 0 && lux < BH1750_RANGE_DOWN(bh1750_ranges[range - 1].upperLux)) {
+    range--;
+  }
+  if (range != bh1750_range) {
+    LREP("[BH1750] range %d -> %d\r\n", bh1750_range, range);
+    bh1750_range = range;
+  }
+}
+
 /**
  * Configure BH1750 MTreg value
  * MT reg = Measurement Time register
@@ -46,22 +142,23 @@ bool bh1750_init(uint8 mode) {
  * 		false if MTreg not changed or parameter out of range
  */
 bool bh1750_setMTreg(uint8 MTreg) {
-  bh1750_MTreg = MTreg;
+  uint8 cmds[2];
+  
   //Bug: lowest value seems to be 32!
   if (MTreg <= 31 || MTreg > 254) {
     LREPMaster("[BH1750] ERROR: MTreg out of range\r\n");
     return 0;
   }
-  // Send MTreg and the current mode to the sensor
-  //   High bit: 01000_MT[7,6,5]
-  //    Low bit: 011_MT[4,3,2,1,0]
-  bh1850_Write((0x08 << 3) | (MTreg >> 5));
-  bh1850_Write((0x03 << 5 )  | (MTreg & 0x1F));
+  cmds[0] = BH1750_MTREG_HIGH(MTreg);
+  cmds[1] = BH1750_MTREG_LOW(MTreg);
+  if (bh1850_WriteSequence(cmds, sizeof(cmds)) != I2C_SUCCESS) {
+    return 0;
+  }
+  bh1750_MTreg = MTreg;
+  bh1750_scaleQ12 = BH1750_SCALE_Q12(MTreg);
   
-  // Wait a few moments to wake up
-  bh1750_WaitMs(10);
-
-  return 0;
+  // takes effect with the next measurement command, nothing to wait for
+  return 1;
 }
 
 void bh1850_PowerDown(void) {
@@ -70,25 +167,56 @@ void bh1850_PowerDown(void) {
   }
 }
 
-float bh1850_Read(void) {
-    uint8 address = ((BH1750_I2CADDR << 1) | OCM_READ);
-    uint8 buf[] = {0x00, 0x00};
-    HalI2CReceive(address, buf, 2);
-    uint16 value16 = ((buf[0] << 8) | buf[1]);
-    float level = 0;
-    level = value16;
-    if (bh1750_MTreg != BH1750_DEFAULT_MTREG) {
-      level *= (float)((uint8)BH1750_DEFAULT_MTREG/(float)bh1750_MTreg);
-    }
+/**
+ * Read the last measurement
+ * @return uint32 lux in 1/256 lx
+ */
+uint32 bh1850_Read(void) {
+    uint16 value16 = 0;
+    bh1750_readCount(&value16);
+    // count * DEFAULT_MTREG / MTreg / 1.2 in Q12, down to Q8
+    uint32 level = ((uint32)value16 * bh1750_scaleQ12) >> (12 - 8);
     if (bh1750_mode == ONE_TIME_HIGH_RES_MODE_2 || bh1750_mode == CONTINUOUS_HIGH_RES_MODE_2) {
-      level /= 2;
+      level >>= 1;
     }
-    // Convert raw value to lux
-    level /= BH1750_CONV_FACTOR;
-    LREP("[BH1750] level %d \r\n", (uint16)level);
+    LREP("[BH1750] level %d \r\n", (uint16)(level >> 8));
     return level; 
 }
 
+/**
+ * Raw measurement result
+ * @param count result register, 0 if the sensor didn't answer
+ * @return int8 I2C_SUCCESS if the sensor acked
+ */
+static int8 bh1750_readCount(uint16 *count) {
+    uint8 buf[] = {0x00, 0x00};
+    halI2CSegment_t seg = {buf, sizeof(buf), HAL_I2C_SEG_READ};
+    int8 status = HalI2CTransfer(BH1750_I2CADDR, &seg, 1);
+    
+    *count = (status == I2C_SUCCESS) ? ((buf[0] << 8) | buf[1]) : 0;
+    return status;
+}
+
+/**
+ * Send single byte commands in one bus session, the BH1750 takes one
+ * command per write so they are separated by STOP
+ * @return int8 I2C_SUCCESS if all commands were acked
+ */
+static int8 bh1850_WriteSequence(const uint8 *cmds, uint8 count) {
+    halI2CSegment_t segs[4];
+    uint8 i;
+    
+    if (count > sizeof(segs) / sizeof(segs[0])) {
+      return I2C_ERROR;
+    }
+    for (i = 0; i < count; i++) {
+      segs[i].buf = (uint8 *)&cmds[i];
+      segs[i].len = 1;
+      segs[i].flags = HAL_I2C_SEG_STOP;
+    }
+    return HalI2CTransfer(BH1750_I2CADDR, segs, count);
+}
+
 void bh1850_Write(uint8 mode) {
     // begin the write sequence with the address byte
     uint8 address = ((BH1750_I2CADDR << 1) | OCM_WRITE);
@@ -110,18 +238,3 @@ void bh1850_Write(uint8 mode) {
 
   }
 }
-
-void bh1750_WaitUs(uint16 microSecs) {
-  while(microSecs--) {
-    /* 32 NOPs == 1 usecs */
-    asm("nop"); asm("nop"); asm("nop"); asm("nop"); asm("nop");
-    asm("nop"); asm("nop"); asm("nop"); asm("nop"); asm("nop");
-    asm("nop"); asm("nop"); asm("nop"); asm("nop"); asm("nop");
-    asm("nop"); asm("nop"); asm("nop"); asm("nop"); asm("nop");
-    asm("nop"); asm("nop"); asm("nop"); asm("nop"); asm("nop");
-    asm("nop"); asm("nop"); asm("nop"); asm("nop"); asm("nop");
-    asm("nop"); asm("nop");
-  }
-}
-
-void bh1750_WaitMs(uint32_t period) { bh1750_WaitUs(period * 1000); }
\ No newline at end of file
@@ -27,23 +27,34 @@
       // Measurement at 4 lux resolution. Measurement time is approx 16ms.
 #define ONE_TIME_LOW_RES_MODE 0x23
 
-#define BH1750_CONV_FACTOR 1.2
+// lux per count in Q12 is 4096 * DEFAULT_MTREG / MTreg / 1.2
+#define BH1750_LUX_Q12 235520UL
+#define BH1750_SCALE_Q12(MTreg) ((uint16)(BH1750_LUX_Q12 / (MTreg)))
 
 #define BH1750_I2CADDR 0x23
 
+// MTreg is sent in two commands
+//   High bit: 01000_MT[7,6,5]
+//    Low bit: 011_MT[4,3,2,1,0]
+#define BH1750_MTREG_HIGH(MTreg) ((0x08 << 3) | ((MTreg) >> 5))
+#define BH1750_MTREG_LOW(MTreg) ((0x03 << 5) | ((MTreg) & 0x1F))
+
 //extern uint8 bh1750_mode = CONTINUOUS_HIGH_RES_MODE;
 //extern uint8 bh1750_addr = BH1750_I2CADDR;
 //extern uint8 bh1750_mode;
 //extern uint8 bh1750_addr;
 
-extern bool bh1750_init(uint8 mode);
+// max low resolution measurement time, see bh1750_startProbe
+#define BH1750_PROBE_TIME_MS 24
+
+extern void bh1750_startProbe(void);
+extern bool bh1750_finishProbe(void);
+extern void bh1750_startMeasurement(void);
+extern uint16 bh1750_measurementTimeMs(void);
+extern void bh1750_autoRange(uint16 lux);
 extern bool bh1750_setMTreg(uint8 MTreg);
-extern float bh1850_Read(void);
+extern uint32 bh1850_Read(void);
 extern void bh1850_Write(uint8 mode);
 extern void bh1850_PowerDown(void);
 
-void bh1750_WaitUs(uint16 microSecs);
-void bh1750_WaitMs(uint32_t period);
-
-//const float BH1750_CONV_FACTOR = 1.2;
 #endif
\ No newline at end of file
@@ -1,5 +1,9 @@
 #include "bme280spi.h"
 #include "Debug.h"
+#include "ZComDef.h"
+#include "OSAL_Nv.h"
+#include "hal_spi_dma.h"
+#include "hal_delay.h"
 
 #include <stdlib.h>
 
@@ -14,7 +18,7 @@
   P1.1 - LCD_FLASH_RESET (RST)
   P1.2 - LCD_CS (CS)
 
-  //spi
+  //spi, see hal_spi_dma.h
   P1.5 - CLK
   P1.6 - MOSI
   P1.7 - MISO
@@ -30,21 +34,6 @@
 #define HAL_LCD_CS_PORT 1
 #define HAL_LCD_CS_PIN  2
 
-/* LCD SPI lines */
-#define HAL_LCD_CLK_PORT 1
-#define HAL_LCD_CLK_PIN  5
-
-#define HAL_LCD_MOSI_PORT 1
-#define HAL_LCD_MOSI_PIN  6
-
-#define HAL_LCD_MISO_PORT 1
-#define HAL_LCD_MISO_PIN  7
-
-/* SPI settings */
-#define HAL_SPI_CLOCK_POL_LO       0x00 // CPOL 0 0x00, CPOL 1 0x80
-#define HAL_SPI_CLOCK_PHA_0        0x00 // CPHA 0 0x00, CPHA 1 0x40
-#define HAL_SPI_TRANSFER_MSB_FIRST 0x20 // ORDER 0 0x00 LSB first, ORDER 1 0x20 MSB first
-
 #define HAL_IO_SET(port, pin, val)        HAL_IO_SET_PREP(port, pin, val)
 #define HAL_IO_SET_PREP(port, pin, val)   st( P##port##_##pin = val; )
 
@@ -58,28 +47,6 @@
                                                       P##port##_##pin = val; \
                                                       P##port##DIR &= ~BV(pin); )
 
-#define HAL_CONFIG_IO_PERIPHERAL(port, pin)      HAL_CONFIG_IO_PERIPHERAL_PREP(port, pin)
-#define HAL_CONFIG_IO_PERIPHERAL_PREP(port, pin) st( P##port##SEL |= BV(pin); )
-
-#define HAL_CONFIG_IO_GP(port, pin)      HAL_CONFIG_IO_GP_PREP(port, pin)
-#define HAL_CONFIG_IO_GP_PREP(port, pin) st( P##port##SEL &= ~BV(pin); )
-
-
-/* SPI interface control */
-#define LCD_SPI_BEGIN()     HAL_IO_SET(HAL_LCD_CS_PORT,  HAL_LCD_CS_PIN,  0); /* chip select */
-#define LCD_SPI_END()                                                         \
-{                                                                             \
-  asm("NOP");                                                                 \
-  asm("NOP");                                                                 \
-  asm("NOP");                                                                 \
-  asm("NOP");                                                                 \
-  HAL_IO_SET(HAL_LCD_CS_PORT,  HAL_LCD_CS_PIN,  1); /* chip select */         \
-}
-/* clear the received and transmit byte status, write tx data to buffer, wait till transmit done */
-#define LCD_SPI_TX(x)                   { U1CSR &= ~(BV(2) | BV(1)); U1DBUF = x; while( !(U1CSR & BV(1)) ); }
-#define LCD_SPI_WAIT_RXRDY()            { while(!(U1CSR & BV(1))); }
-
-
 /* Control macros */
 //#define LCD_DO_WRITE()        HAL_IO_SET(HAL_LCD_MODE_PORT,  HAL_LCD_MODE_PIN,  1);
 //#define LCD_DO_CONTROL()      HAL_IO_SET(HAL_LCD_MODE_PORT,  HAL_LCD_MODE_PIN,  0);
@@ -87,54 +54,55 @@
 //#define LCD_ACTIVATE_RESET()  HAL_IO_SET(HAL_LCD_RESET_PORT, HAL_LCD_RESET_PIN, 0);
 //#define LCD_RELEASE_RESET()   HAL_IO_SET(HAL_LCD_RESET_PORT, HAL_LCD_RESET_PIN, 1);
 
-void bme_HW_WaitUs(uint16 i);
 void bme280_write8(uint8 reg, uint8 data);
 uint8 bme280_read8(uint8 reg);
 bool bme280_isReadingCalibration(void);
 void bme280_readCoefficients(void);
-uint8 LCD_SPI_WAIT_RX(void);
-uint16 bme280_read16(uint8 reg);
-uint16 bme280_read16_LE(uint8 reg);
-int16 bme280_readS16(uint8 reg);
-uint32 bme280_read24(uint8 reg);
-float bme280_readTemperature(void);
-float bme280_readHumidity(void);
-float bme280_readPressure(void);
-void bme280_takeForcedMeasurement(void);
+static bool bme280_restoreCoefficients(uint8 chip);
+static void bme280_saveCoefficients(uint8 chip);
+void bme280_readBurst(uint8 reg, uint8 *buf, uint8 len);
+void bme280_triggerForcedMeasurement(void);
+static void bme280_chipSelect(uint8 select);
+static void bme280_spiRun(halSpiDmaXfer_t *xfer);
+
+#define BME280_TEMPERATURE_MIN  -4000    // 0.01 degC
+#define BME280_TEMPERATURE_MAX  8500     // 0.01 degC
+#define BME280_HUMIDITY_MAX     419430400 // 100 %RH before the final >> 12
+#define BME280_PRESSURE_MIN     30000    // Pa
+#define BME280_PRESSURE_MAX     110000   // Pa
 
 int32 t_fine;
 
-/**************************************************************************/
 /*!
-    @brief  calibration data
-*/
-/**************************************************************************/
-  uint16 bme280_dig_T1; ///< temperature compensation value
-  int16 bme280_dig_T2;  ///< temperature compensation value
-  int16 bme280_dig_T3;  ///< temperature compensation value
-
-  uint16 bme280_dig_P1; ///< pressure compensation value
-  int16 bme280_dig_P2;  ///< pressure compensation value
-  int16 bme280_dig_P3;  ///< pressure compensation value
-  int16 bme280_dig_P4;  ///< pressure compensation value
-  int16 bme280_dig_P5;  ///< pressure compensation value
-  int16 bme280_dig_P6;  ///< pressure compensation value
-  int16 bme280_dig_P7;  ///< pressure compensation value
-  int16 bme280_dig_P8;  ///< pressure compensation value
-  int16 bme280_dig_P9;  ///< pressure compensation value
-
-  uint8 bme280_dig_H1; ///< humidity compensation value
-  int16 bme280_dig_H2; ///< humidity compensation value
-  uint8 bme280_dig_H3; ///< humidity compensation value
-  int16 bme280_dig_H4; ///< humidity compensation value
-  int16 bme280_dig_H5; ///< humidity compensation value
-  int8 bme280_dig_H6;  ///< humidity compensation value
-
-
-uint8 LCD_SPI_WAIT_RX(void) { 
-  while(!(U1CSR & BV(1))); 
-  return U1DBUF; 
-}
+ *  @brief  sampling profiles, DS 3.5 recommended modes of operation
+ */
+static const struct {
+    sensor_sampling tempSampling;
+    sensor_sampling pressSampling;
+    sensor_sampling humSampling;
+    sensor_filter filter;
+} bme280_profiles[BME280_PROFILE_COUNT] = {
+    {SAMPLING_X1, SAMPLING_X1, SAMPLING_X1, FILTER_OFF},  // BME280_PROFILE_ULTRA_LOW_POWER
+    {SAMPLING_X2, SAMPLING_X4, SAMPLING_X2, FILTER_X4},   // BME280_PROFILE_WEATHER_STATION
+    {SAMPLING_X2, SAMPLING_X16, SAMPLING_X1, FILTER_X16}  // BME280_PROFILE_INDOOR_NAVIGATION
+};
+
+// supply current while measuring, DS table 1
+#define BME280_IDD_TEMPERATURE_UA 350
+#define BME280_IDD_PRESSURE_UA    714
+#define BME280_IDD_HUMIDITY_UA    340
+
+static uint8 bme280_ctrlMeas; ///< osrs_t | osrs_p, mode bits cleared
+static uint8 bme280_ctrlHum;  ///< osrs_h
+
+bme280_calib_t bme280_calib; ///< trimming parameters, see DS 4.2.2
+
+// SPI mode 00, 4 MHz is the USART limit, BME280 is rated for 10 MHz
+static const halSpiDmaDevice_t bme280_spiDevice = {
+  HAL_SPI_DMA_BAUD_E_4MHZ, 0,
+  HAL_SPI_DMA_MSB_FIRST | HAL_SPI_DMA_CPHA_0 | HAL_SPI_DMA_CPOL_LO,
+  bme280_chipSelect
+};
 
 bool BME280Init(void) {
   
@@ -142,7 +110,7 @@ bool BME280Init(void) {
   bme_ConfigIO();
 
   /* Initialize SPI */
-  bme_ConfigSPI();
+  HalSpiDmaInit();
 
 
   // check if sensor, i.e. the chip ID is correct
@@ -152,7 +120,7 @@ bool BME280Init(void) {
     LREPMaster("NOT BME280\r\n");
     /* Initialize GPIO */
     bme_ConfigIOInput();
-    bme_ConfigGP();
+    HalSpiDmaRelease();
     return 0;
   }
   
@@ -161,18 +129,20 @@ bool BME280Init(void) {
   bme280_write8(BME280_REGISTER_SOFTRESET, 0xB6);
   
   // wait for chip to wake up.  
-  bme_HW_WaitUs(10);
+  HalDelayUs(10);
   
   // if chip is still reading calibration, delay
   while (bme280_isReadingCalibration())
-  bme_HW_WaitUs(10);
+  HalDelayUs(10);
 
-  bme280_readCoefficients(); // read trimming parameters, see DS 4.2.2
+  if (!bme280_restoreCoefficients(chip)) {
+    bme280_readCoefficients(); // read trimming parameters, see DS 4.2.2
+    bme280_saveCoefficients(chip);
+  }
 
-//  bme280_setSampling(MODE_NORMAL, SAMPLING_X16, SAMPLING_X16, SAMPLING_X16, FILTER_OFF, STANDBY_MS_0_5); // use defaults
-  bme280_setSampling(MODE_FORCED, SAMPLING_X2, SAMPLING_X16, SAMPLING_X1, FILTER_X16, STANDBY_MS_62_5); // air
+  bme280_setProfile(BME280_PROFILE_DEFAULT);
     
-  bme_HW_WaitUs(100);
+  HalDelayUs(100);
   
 //  float temperature = bme280_readTemperature();
 //  LREP("Temperature=%d\r\n", temperature);
@@ -194,81 +164,33 @@ void bme_ConfigIOInput(void)
   HAL_CONFIG_IO_INPUT(HAL_LCD_CS_PORT,    HAL_LCD_CS_PIN,    0);
 }
 
-void bme_ConfigSPI(void)
-{
-  /* UART/SPI Peripheral configuration */
-
-   uint8 baud_exponent;
-   uint8 baud_mantissa;
-
-  /* Set SPI on UART 1 alternative 2 */
-  PERCFG |= 0x02;
-
-  /* Configure clk, master out and master in lines */
-  HAL_CONFIG_IO_PERIPHERAL(HAL_LCD_CLK_PORT,  HAL_LCD_CLK_PIN);
-  HAL_CONFIG_IO_PERIPHERAL(HAL_LCD_MOSI_PORT, HAL_LCD_MOSI_PIN);
-  HAL_CONFIG_IO_PERIPHERAL(HAL_LCD_MISO_PORT, HAL_LCD_MISO_PIN);
-
-
-  /* Set SPI speed to 1 MHz (the values assume system clk of 32MHz)
-   * Confirm on board that this results in 1MHz spi clk.
-   */
-  baud_exponent = 15;
-  baud_mantissa =  0;
-
-  /* Configure SPI */
-  U1UCR  = 0x00;      /* Flush and goto IDLE state. 8-N-1. */
-  U1CSR  = 0x00;      /* SPI mode, master. */
-  U1GCR  = HAL_SPI_TRANSFER_MSB_FIRST | HAL_SPI_CLOCK_PHA_0 | HAL_SPI_CLOCK_POL_LO | baud_exponent;
-  U1BAUD = baud_mantissa;
-}
-
-void bme_ConfigGP(void)
-{
-  /* Set SPI on UART 1 alternative 2 */
-  PERCFG &= ~0x02;
-
-  /* Configure clk, master out and master in lines */
-  HAL_CONFIG_IO_GP(HAL_LCD_CLK_PORT,  HAL_LCD_CLK_PIN);
-  HAL_CONFIG_IO_GP(HAL_LCD_MOSI_PORT, HAL_LCD_MOSI_PIN);
-  HAL_CONFIG_IO_GP(HAL_LCD_MISO_PORT, HAL_LCD_MISO_PIN);
+static void bme280_chipSelect(uint8 select) {
+  HAL_IO_SET(HAL_LCD_CS_PORT, HAL_LCD_CS_PIN, select ? 0 : 1);
 }
 
-void bme_HW_WaitUs(uint16 microSecs)
-{
-  while(microSecs--)
-  {
-    /* 32 NOPs == 1 usecs */
-    asm("nop"); asm("nop"); asm("nop"); asm("nop"); asm("nop");
-    asm("nop"); asm("nop"); asm("nop"); asm("nop"); asm("nop");
-    asm("nop"); asm("nop"); asm("nop"); asm("nop"); asm("nop");
-    asm("nop"); asm("nop"); asm("nop"); asm("nop"); asm("nop");
-    asm("nop"); asm("nop"); asm("nop"); asm("nop"); asm("nop");
-    asm("nop"); asm("nop"); asm("nop"); asm("nop"); asm("nop");
-    asm("nop"); asm("nop");
-  }
+/*!
+ *   @brief  run one SPI transfer and idle until it is done
+ */
+static void bme280_spiRun(halSpiDmaXfer_t *xfer) {
+  HalSpiDmaWait(); // bus may still be busy with another device
+  HalSpiDmaTransfer(&bme280_spiDevice, xfer);
+  HalSpiDmaWait();
 }
 
 void bme280_write8(uint8 reg, uint8 data)
 {
-  LCD_SPI_BEGIN();
-  LCD_SPI_TX(reg & ~0x80);
-  LCD_SPI_WAIT_RXRDY();
-  LCD_SPI_TX(data);
-  LCD_SPI_WAIT_RXRDY();
-  LCD_SPI_END();
+  uint8 tx[2];
+  halSpiDmaXfer_t xfer = {tx, NULL, sizeof(tx), 0, NULL};
+
+  tx[0] = reg & ~0x80;
+  tx[1] = data;
+  bme280_spiRun(&xfer);
 }
 
 uint8 bme280_read8(uint8 reg)
 {
   uint8 value = 0;
-  LCD_SPI_BEGIN();
-  LCD_SPI_TX(reg | 0x80);
-  LCD_SPI_WAIT_RXRDY();
-  LCD_SPI_TX(0);
-  LCD_SPI_WAIT_RXRDY();
-  value = LCD_SPI_WAIT_RX();
-  LCD_SPI_END();
+  bme280_readBurst(reg, &value, 1);
   return value;
 }
 
@@ -279,88 +201,105 @@ bool bme280_isReadingCalibration(void) {
 }
 
 void bme280_readCoefficients(void) {
-  bme280_dig_T1  = bme280_read16_LE(BME280_REGISTER_DIG_T1);
-  bme280_dig_T2 = bme280_readS16_LE(BME280_REGISTER_DIG_T2);
-  bme280_dig_T3 = bme280_readS16_LE(BME280_REGISTER_DIG_T3);
-
-  bme280_dig_P1 = bme280_read16_LE(BME280_REGISTER_DIG_P1);
-  bme280_dig_P2 = bme280_readS16_LE(BME280_REGISTER_DIG_P2);
-  bme280_dig_P3 = bme280_readS16_LE(BME280_REGISTER_DIG_P3);
-  bme280_dig_P4 = bme280_readS16_LE(BME280_REGISTER_DIG_P4);
-  bme280_dig_P5 = bme280_readS16_LE(BME280_REGISTER_DIG_P5);
-  bme280_dig_P6 = bme280_readS16_LE(BME280_REGISTER_DIG_P6);
-  bme280_dig_P7 = bme280_readS16_LE(BME280_REGISTER_DIG_P7);
-  bme280_dig_P8 = bme280_readS16_LE(BME280_REGISTER_DIG_P8);
-  bme280_dig_P9 = bme280_readS16_LE(BME280_REGISTER_DIG_P9);
-
-  bme280_dig_H1 = bme280_read8(BME280_REGISTER_DIG_H1);
-  bme280_dig_H2 = bme280_readS16_LE(BME280_REGISTER_DIG_H2);
-  bme280_dig_H3 = bme280_read8(BME280_REGISTER_DIG_H3);
-  bme280_dig_H4 = ((int8)bme280_read8(BME280_REGISTER_DIG_H4) << 4) |
-                         (bme280_read8(BME280_REGISTER_DIG_H4 + 1) & 0xF);
-  bme280_dig_H5 = ((int8)bme280_read8(BME280_REGISTER_DIG_H5 + 1) << 4) |
-                         (bme280_read8(BME280_REGISTER_DIG_H5) >> 4);
-  bme280_dig_H6 = (int8)bme280_read8(BME280_REGISTER_DIG_H6);
+  uint8 buf[BME280_CALIB_TP_LEN];
+
+  // dig_T1..dig_P9, unused 0xA0, dig_H1
+  bme280_readBurst(BME280_REGISTER_DIG_T1, buf, BME280_CALIB_TP_LEN);
+  bme280_calib.dig_T1 = ((uint16)buf[1] << 8) | buf[0];
+  bme280_calib.dig_T2 = (int16)(((uint16)buf[3] << 8) | buf[2]);
+  bme280_calib.dig_T3 = (int16)(((uint16)buf[5] << 8) | buf[4]);
+
+  bme280_calib.dig_P1 = ((uint16)buf[7] << 8) | buf[6];
+  bme280_calib.dig_P2 = (int16)(((uint16)buf[9] << 8) | buf[8]);
+  bme280_calib.dig_P3 = (int16)(((uint16)buf[11] << 8) | buf[10]);
+  bme280_calib.dig_P4 = (int16)(((uint16)buf[13] << 8) | buf[12]);
+  bme280_calib.dig_P5 = (int16)(((uint16)buf[15] << 8) | buf[14]);
+  bme280_calib.dig_P6 = (int16)(((uint16)buf[17] << 8) | buf[16]);
+  bme280_calib.dig_P7 = (int16)(((uint16)buf[19] << 8) | buf[18]);
+  bme280_calib.dig_P8 = (int16)(((uint16)buf[21] << 8) | buf[20]);
+  bme280_calib.dig_P9 = (int16)(((uint16)buf[23] << 8) | buf[22]);
+
+  bme280_calib.dig_H1 = buf[25];
+
+  // dig_H2..dig_H6, H4 and H5 share 0xE5
+  bme280_readBurst(BME280_REGISTER_DIG_H2, buf, BME280_CALIB_H_LEN);
+  bme280_calib.dig_H2 = (int16)(((uint16)buf[1] << 8) | buf[0]);
+  bme280_calib.dig_H3 = buf[2];
+  bme280_calib.dig_H4 = ((int16)(int8)buf[3] << 4) | (buf[4] & 0xF);
+  bme280_calib.dig_H5 = ((int16)(int8)buf[5] << 4) | (buf[4] >> 4);
+  bme280_calib.dig_H6 = (int8)buf[6];
 }
 
+/*!
+ *   @brief  load trimming parameters cached by a previous boot
+ *
+ *   Every BME280 has the same chip ID, so the cache is checked against
+ *   the unit's own dig_T1..dig_T3 as well, a short burst instead of the
+ *   full readout. Another module gets its parameters read again.
+ *
+ *   @param chip chip ID the cache must have been written for
+ *   @return TRUE if bme280_calib was filled from NV
+ */
+static bool bme280_restoreCoefficients(uint8 chip) {
+  bme280_nv_calib_t nv;
+  uint8 buf[6];
 
-uint16 bme280_read16(uint8 reg) {
-  uint16 value16;
-  
-  LCD_SPI_BEGIN();
-  LCD_SPI_TX(reg | 0x80);
-  LCD_SPI_WAIT_RXRDY();
-  
-  LCD_SPI_TX(0);
-  LCD_SPI_WAIT_RXRDY();
-  uint8 value_H = LCD_SPI_WAIT_RX();
-  LCD_SPI_TX(0);
-  LCD_SPI_WAIT_RXRDY();
-  uint8 value_L = LCD_SPI_WAIT_RX();
-  LCD_SPI_END();
-  
-  value16 = (value_H << 8) | value_L;
-
-  return value16;
+  if (osal_nv_item_init(NW_BME280_CALIB, sizeof(bme280_nv_calib_t), NULL) != ZSUCCESS) {
+    return 0;
+  }
+  if (osal_nv_read(NW_BME280_CALIB, 0, sizeof(bme280_nv_calib_t), &nv) != ZSUCCESS || nv.chipId != chip) {
+    return 0;
+  }
+  bme280_readBurst(BME280_REGISTER_DIG_T1, buf, sizeof(buf));
+  if (nv.calib.dig_T1 != (((uint16)buf[1] << 8) | buf[0]) ||
+      nv.calib.dig_T2 != (int16)(((uint16)buf[3] << 8) | buf[2]) ||
+      nv.calib.dig_T3 != (int16)(((uint16)buf[5] << 8) | buf[4])) {
+    LREPMaster("BME280 calibration in NV belongs to another unit\r\n");
+    return 0;
+  }
+  bme280_calib = nv.calib;
+  LREPMaster("BME280 calibration restored from NV\r\n");
+  return 1;
 }
 
-uint16 bme280_read16_LE(uint8 reg) {
-  uint16 temp = bme280_read16(reg);
-  return (temp >> 8) | (temp << 8);
-}
+static void bme280_saveCoefficients(uint8 chip) {
+  bme280_nv_calib_t nv;
 
-int16 bme280_readS16(uint8 reg) {
-  return (int16)bme280_read16(reg); 
+  nv.chipId = chip;
+  nv.calib = bme280_calib;
+  uint8 writeStatus = osal_nv_write(NW_BME280_CALIB, 0, sizeof(bme280_nv_calib_t), &nv);
+  LREP("BME280 calibration saved to NV write=%d\r\n", writeStatus);
 }
 
-int16 bme280_readS16_LE(uint8 reg) {
-  return (int16)bme280_read16_LE(reg);
+void bme280_readBurst(uint8 reg, uint8 *buf, uint8 len) {
+  uint8 cmd = reg | 0x80;
+  halSpiDmaXfer_t header = {&cmd, NULL, 1, HAL_SPI_DMA_HOLD_CS, NULL};
+  halSpiDmaXfer_t data = {NULL, buf, len, 0, NULL};
+
+  // register address and data in one chip select frame, the sensor
+  // auto-increments the address
+  bme280_spiRun(&header);
+  bme280_spiRun(&data);
 }
 
-uint32 bme280_read24(uint8 reg) {
-  uint32 value32;
-
-  LCD_SPI_BEGIN();
-  LCD_SPI_TX(reg | 0x80);
-  LCD_SPI_WAIT_RXRDY();
-
-    LCD_SPI_TX(0);
-    LCD_SPI_WAIT_RXRDY();
-    uint32 value32_1 = (uint32)LCD_SPI_WAIT_RX();
-    value32_1 <<= 12;
-
-    LCD_SPI_TX(0);
-    LCD_SPI_WAIT_RXRDY();
-    uint32 value32_2 = (uint32)LCD_SPI_WAIT_RX();
-    value32_2 <<= 4;
-
-    LCD_SPI_TX(0);
-    LCD_SPI_WAIT_RXRDY();
-    uint32 value32_3 = (uint32)LCD_SPI_WAIT_RX();
-    value32_3 >>= 4;
-    LCD_SPI_END();
-    value32 = value32_1 | value32_2 | value32_3;
-  return value32;
+/*!
+ *   @brief  read press/temp/hum data registers 0xF7..0xFE in one burst
+ *
+ *   The burst keeps all three values from the same measurement (DS 4).
+ *   @param raw receives the unpacked 20/20/16 bit ADC values
+ *   @return FALSE if the sensor did not answer or skipped the measurement
+ */
+bool bme280_readAll(bme280_raw_t *raw) {
+  uint8 buf[BME280_DATA_LEN];
+
+  bme280_readBurst(BME280_REGISTER_PRESSUREDATA, buf, BME280_DATA_LEN);
+
+  raw->adc_P = ((uint32)buf[0] << 12) | ((uint32)buf[1] << 4) | (buf[2] >> 4);
+  raw->adc_T = ((uint32)buf[3] << 12) | ((uint32)buf[4] << 4) | (buf[5] >> 4);
+  raw->adc_H = ((uint32)buf[6] << 8) | buf[7];
+
+  // 0x80000 is the reset/skipped value, 0 and 0xFFFFF mean nobody drives MISO
+  return raw->adc_T != 0x80000 && raw->adc_T != 0xFFFFF && raw->adc_T != 0;
 }
 
 /*!
@@ -392,6 +331,9 @@ void bme280_setSampling(sensor_mode mode,
   // CONTROLHUMID register, otherwise the values won't be applied (see
   // DS 5.4.3)
 
+  bme280_ctrlMeas = (tempSampling << 5) | (pressSampling << 2);
+  bme280_ctrlHum = humSampling;
+
 //  LREP("BME280_REGISTER_CONTROLHUMID=%d\r\n", humSampling);
   bme280_write8(BME280_REGISTER_CONTROLHUMID, humSampling);
 
@@ -403,34 +345,102 @@ void bme280_setSampling(sensor_mode mode,
 
 }
 
-void bme280_takeForcedMeasurement(void) {
-  // If we are in forced mode, the BME sensor goes back to sleep after each
-  // measurement and we need to set it to forced mode once at this point, so
-  // it will take the next measurement and then return to sleep again.
-  // In normal mode simply does new measurements periodically.
+/*!
+ *   @brief  start a forced measurement and return without waiting
+ *
+ *   The sensor goes back to sleep by itself once the conversion is done.
+ *   Read the result with bme280_readAll after bme280_measurementTimeMs.
+ */
+void bme280_triggerForcedMeasurement(void) {
+  bme280_write8(BME280_REGISTER_CONTROL, bme280_ctrlMeas | MODE_FORCED);
+}
 
-    bme280_write8(BME280_REGISTER_CONTROL, (SAMPLING_X16 << 5) | (SAMPLING_X16 << 2) | MODE_FORCED);
-    // wait until measurement has been completed, otherwise we would read
-    // the values from the last measurement
-    while (bme280_read8(BME280_REGISTER_STATUS) & 0x08)
-      bme_HW_WaitUs(1000);
+/*!
+ *   @brief  oversampling register value to number of samples
+ */
+static uint8 bme280_oversampling(sensor_sampling sampling) {
+  return sampling == SAMPLING_NONE ? 0 : (uint8)(1 << (sampling - 1));
+}
 
+/*!
+ *   @brief  apply one of the predefined sampling profiles
+ *
+ *   The sensor is left in sleep mode, the next trigger picks the new
+ *   settings up.
+ *   @param profile BME280_PROFILE_*
+ *   @return FALSE if the profile is unknown, settings are left untouched
+ */
+bool bme280_setProfile(uint8 profile) {
+  if (profile >= BME280_PROFILE_COUNT) {
+    return 0;
+  }
+  bme280_setSampling(MODE_SLEEP,
+                     bme280_profiles[profile].tempSampling,
+                     bme280_profiles[profile].pressSampling,
+                     bme280_profiles[profile].humSampling,
+                     bme280_profiles[profile].filter,
+                     STANDBY_MS_62_5);
+  return 1;
 }
 
-float bme280_readTemperature(void)
+/*!
+ *   @brief  maximum conversion phases for the configured oversampling
+ *
+ *   DS 9.1: t_max = 1.25 + 2.3 * T + (2.3 * P + 0.575) + (2.3 * H + 0.575) ms,
+ *   the pressure and humidity terms drop out when they are skipped.
+ *   The start-up 1.25 ms is accounted to the temperature phase.
+ */
+static void bme280_phaseTimesUs(uint32 *tUs, uint32 *pUs, uint32 *hUs) {
+  uint8 osrsT = bme280_oversampling((bme280_ctrlMeas >> 5) & 0x07);
+  uint8 osrsP = bme280_oversampling((bme280_ctrlMeas >> 2) & 0x07);
+  uint8 osrsH = bme280_oversampling(bme280_ctrlHum & 0x07);
+
+  *tUs = 1250 + 2300 * (uint32)osrsT;
+  *pUs = osrsP ? 2300 * (uint32)osrsP + 575 : 0;
+  *hUs = osrsH ? 2300 * (uint32)osrsH + 575 : 0;
+}
+
+/*!
+ *   @brief  maximum conversion time for the configured oversampling
+ *   @return time in ms, rounded up
+ */
+uint16 bme280_measurementTimeMs(void) {
+  uint32 tUs, pUs, hUs;
+
+  bme280_phaseTimesUs(&tUs, &pUs, &hUs);
+  return (uint16)((tUs + pUs + hUs + 999) / 1000);
+}
+
+/*!
+ *   @brief  estimated sensor charge for one forced measurement
+ *   @return charge in nC, worst case conversion time times DS supply current
+ */
+uint16 bme280_sampleChargeNc(void) {
+  uint32 tUs, pUs, hUs;
+
+  bme280_phaseTimesUs(&tUs, &pUs, &hUs);
+  return (uint16)((tUs * BME280_IDD_TEMPERATURE_UA + pUs * BME280_IDD_PRESSURE_UA +
+                   hUs * BME280_IDD_HUMIDITY_UA + 999) / 1000);
+}
+
+#ifdef BME280_FLOAT_COMPENSATION
+/**************************************************************************/
+/*!
+    @brief  double precision compensation, DS 8.1
+*/
+/**************************************************************************/
+static int32 bme280_compensateTemperature(int32 adc_T)
 {
-    int32 adc_T = bme280_read24(BME280_REGISTER_TEMPDATA);
-    
     double var1;
     double var2;
     double temperature;
     double temperature_min = -40;
     double temperature_max = 85;
 
-    var1 = ((double)adc_T) / 16384.0 - ((double)bme280_dig_T1) / 1024.0;
-    var1 = var1 * ((double)bme280_dig_T2);
-    var2 = (((double)adc_T) / 131072.0 - ((double)bme280_dig_T1) / 8192.0);
-    var2 = (var2 * var2) * ((double)bme280_dig_T3);
+    var1 = ((double)adc_T) / 16384.0 - ((double)bme280_calib.dig_T1) / 1024.0;
+    var1 = var1 * ((double)bme280_calib.dig_T2);
+    var2 = (((double)adc_T) / 131072.0 - ((double)bme280_calib.dig_T1) / 8192.0);
+    var2 = (var2 * var2) * ((double)bme280_calib.dig_T3);
     t_fine = (int32_t)(var1 + var2);
     temperature = (var1 + var2) / 5120.0;
     if (temperature < temperature_min)
@@ -442,15 +452,11 @@ float bme280_readTemperature(void)
         temperature = temperature_max;
     }
 
-    return temperature;
+    return (int32)(temperature * 100);
 }
 
-float bme280_readHumidity(void)
+static uint32 bme280_compensateHumidity(int32 adc_H)
 {
-  bme280_readTemperature(); // must be done first to get t_fine
-
-  int32 adc_H = bme280_read16(BME280_REGISTER_HUMIDDATA);
-  
     double humidity;
     double humidity_min = 0.0;
     double humidity_max = 100.0;
@@ -462,13 +468,13 @@ float bme280_readHumidity(void)
     double var6;
 
     var1 = ((double)t_fine) - 76800.0;
-    var2 = (((double)bme280_dig_H4) * 64.0 + (((double)bme280_dig_H5) / 16384.0) * var1);
+    var2 = (((double)bme280_calib.dig_H4) * 64.0 + (((double)bme280_calib.dig_H5) / 16384.0) * var1);
     var3 = adc_H - var2;
-    var4 = ((double)bme280_dig_H2) / 65536.0;
-    var5 = (1.0 + (((double)bme280_dig_H3) / 67108864.0) * var1);
-    var6 = 1.0 + (((double)bme280_dig_H6) / 67108864.0) * var1 * var5;
+    var4 = ((double)bme280_calib.dig_H2) / 65536.0;
+    var5 = (1.0 + (((double)bme280_calib.dig_H3) / 67108864.0) * var1);
+    var6 = 1.0 + (((double)bme280_calib.dig_H6) / 67108864.0) * var1 * var5;
     var6 = var3 * var4 * (var5 * var6);
-    humidity = var6 * (1.0 - ((double)bme280_dig_H1) * var6 / 524288.0);
+    humidity = var6 * (1.0 - ((double)bme280_calib.dig_H1) * var6 / 524288.0);
 
     if (humidity > humidity_max)
     {
@@ -479,14 +485,11 @@ float bme280_readHumidity(void)
         humidity = humidity_min;
     }
 
-    return humidity ;
+    return (uint32)(humidity * 1024);
 }
 
-float bme280_readPressure(void)
+static uint32 bme280_compensatePressure(int32 adc_P)
 {
-  
-//  bme280_readTemperature(); // must be done first to get t_fine
-  int32 adc_P = bme280_read24(BME280_REGISTER_PRESSUREDATA);
     double var1;
     double var2;
     double var3;
@@ -495,21 +498,21 @@ float bme280_readPressure(void)
     double pressure_max = 110000.0;
 
     var1 = ((double)t_fine / 2.0) - 64000.0;
-    var2 = var1 * var1 * ((double)bme280_dig_P6) / 32768.0;
-    var2 = var2 + var1 * ((double)bme280_dig_P5) * 2.0;
-    var2 = (var2 / 4.0) + (((double)bme280_dig_P4) * 65536.0);
-    var3 = ((double)bme280_dig_P3) * var1 * var1 / 524288.0;
-    var1 = (var3 + ((double)bme280_dig_P2) * var1) / 524288.0;
-    var1 = (1.0 + var1 / 32768.0) * ((double)bme280_dig_P1);
+    var2 = var1 * var1 * ((double)bme280_calib.dig_P6) / 32768.0;
+    var2 = var2 + var1 * ((double)bme280_calib.dig_P5) * 2.0;
+    var2 = (var2 / 4.0) + (((double)bme280_calib.dig_P4) * 65536.0);
+    var3 = ((double)bme280_calib.dig_P3) * var1 * var1 / 524288.0;
+    var1 = (var3 + ((double)bme280_calib.dig_P2) * var1) / 524288.0;
+    var1 = (1.0 + var1 / 32768.0) * ((double)bme280_calib.dig_P1);
 
     /* avoid exception caused by division by zero */
     if (var1 > (0.0))
     {
         pressure = 1048576.0 - (double) adc_P;
         pressure = (pressure - (var2 / 4096.0)) * 6250.0 / var1;
-        var1 = ((double)bme280_dig_P9) * pressure * pressure / 2147483648.0;
-        var2 = pressure * ((double)bme280_dig_P8) / 32768.0;
-        pressure = pressure + (var1 + var2 + ((double)bme280_dig_P7)) / 16.0;
+        var1 = ((double)bme280_calib.dig_P9) * pressure * pressure / 2147483648.0;
+        var2 = pressure * ((double)bme280_calib.dig_P8) / 32768.0;
+        pressure = pressure + (var1 + var2 + ((double)bme280_calib.dig_P7)) / 16.0;
         if (pressure < pressure_min)
         {
             pressure = pressure_min;
@@ -524,6 +527,119 @@ float bme280_readPressure(void)
         pressure = pressure_min;
     }
 
-    return pressure / 100;
+    return (uint32)pressure;
 }
+#else
+/**************************************************************************/
+/*!
+    @brief  integer compensation, Bosch 32-bit reference (DS 4.2.3, 8.2)
+*/
+/**************************************************************************/
+static int32 bme280_compensateTemperature(int32 adc_T)
+{
+    int32 var1;
+    int32 var2;
+    int32 temperature;
+
+    var1 = ((((adc_T >> 3) - ((int32)bme280_calib.dig_T1 << 1))) * ((int32)bme280_calib.dig_T2)) >> 11;
+    var2 = (adc_T >> 4) - ((int32)bme280_calib.dig_T1);
+    var2 = (((var2 * var2) >> 12) * ((int32)bme280_calib.dig_T3)) >> 14;
+    t_fine = var1 + var2;
+    temperature = (t_fine * 5 + 128) >> 8;
+
+    if (temperature < BME280_TEMPERATURE_MIN)
+    {
+        temperature = BME280_TEMPERATURE_MIN;
+    }
+    else if (temperature > BME280_TEMPERATURE_MAX)
+    {
+        temperature = BME280_TEMPERATURE_MAX;
+    }
 
+    return temperature;
+}
+
+static uint32 bme280_compensateHumidity(int32 adc_H)
+{
+    int32 var1;
+    int32 var2;
+    int32 var3;
+
+    var1 = t_fine - ((int32)76800);
+    var2 = (((adc_H << 14) - (((int32)bme280_calib.dig_H4) << 20) - (((int32)bme280_calib.dig_H5) * var1)) + ((int32)16384)) >> 15;
+    var3 = (((var1 * ((int32)bme280_calib.dig_H6)) >> 10) * (((var1 * ((int32)bme280_calib.dig_H3)) >> 11) + ((int32)32768))) >> 10;
+    var3 = ((var3 + ((int32)2097152)) * ((int32)bme280_calib.dig_H2) + 8192) >> 14;
+    var1 = var2 * var3;
+    var1 = var1 - (((((var1 >> 15) * (var1 >> 15)) >> 7) * ((int32)bme280_calib.dig_H1)) >> 4);
+
+    if (var1 < 0)
+    {
+        var1 = 0;
+    }
+    else if (var1 > BME280_HUMIDITY_MAX)
+    {
+        var1 = BME280_HUMIDITY_MAX;
+    }
+
+    return (uint32)(var1 >> 12);
+}
+
+static uint32 bme280_compensatePressure(int32 adc_P)
+{
+    int32 var1;
+    int32 var2;
+    uint32 pressure;
+
+    var1 = (t_fine >> 1) - ((int32)64000);
+    var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * ((int32)bme280_calib.dig_P6);
+    var2 = var2 + ((var1 * ((int32)bme280_calib.dig_P5)) << 1);
+    var2 = (var2 >> 2) + (((int32)bme280_calib.dig_P4) << 16);
+    var1 = (((((int32)bme280_calib.dig_P3) * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) + ((((int32)bme280_calib.dig_P2) * var1) >> 1)) >> 18;
+    var1 = ((((int32)32768) + var1) * ((int32)bme280_calib.dig_P1)) >> 15;
+
+    /* avoid exception caused by division by zero */
+    if (var1 == 0)
+    {
+        return BME280_PRESSURE_MIN;
+    }
+
+    pressure = (((uint32)(((int32)1048576) - adc_P)) - (var2 >> 12)) * 3125;
+    if (pressure < 0x80000000)
+    {
+        pressure = (pressure << 1) / ((uint32)var1);
+    }
+    else
+    {
+        pressure = (pressure / (uint32)var1) * 2;
+    }
+    var1 = (((int32)bme280_calib.dig_P9) * ((int32)(((pressure >> 3) * (pressure >> 3)) >> 13))) >> 12;
+    var2 = (((int32)(pressure >> 2)) * ((int32)bme280_calib.dig_P8)) >> 13;
+    pressure = (uint32)((int32)pressure + ((var1 + var2 + bme280_calib.dig_P7) >> 4));
+
+    if (pressure < BME280_PRESSURE_MIN)
+    {
+        pressure = BME280_PRESSURE_MIN;
+    }
+    else if (pressure > BME280_PRESSURE_MAX)
+    {
+        pressure = BME280_PRESSURE_MAX;
+    }
+
+    return pressure;
+}
+#endif
+
+/*!
+ *   @brief  compensate a raw sample from bme280_readAll
+ *
+ *   Temperature goes first, it provides t_fine for the other two.
+ *   @param raw ADC values of one measurement
+ *   @param data receives 0.01 degC, 0.01 %RH and Pa
+ */
+void bme280_compensate(const bme280_raw_t *raw, bme280_data_t *data)
+{
+    data->temperature = (int16)bme280_compensateTemperature(raw->adc_T);
+    data->pressure = bme280_compensatePressure(raw->adc_P);
+    // Q22.10 %RH to 0.01 %RH
+    data->humidity = (uint16)((bme280_compensateHumidity(raw->adc_H) * 100 + 512) >> 10);
+}
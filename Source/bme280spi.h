@@ -3,23 +3,76 @@
 
 void bme_ConfigIO(void);
 void bme_ConfigIOInput(void);
-void bme_ConfigSPI(void);
-void bme_ConfigGP(void);
-void bme_HW_WaitUs(uint16 i);
 extern void bme280_write8(uint8 reg, uint8 data);
 extern uint8 bme280_read8(uint8 reg);
-uint8 LCD_SPI_WAIT_RX(void);
-uint16 bme280_read16(uint8 reg);
-uint16 bme280_read16_LE(uint8 reg);
-int16 bme280_readS16(uint8 reg);
-int16 bme280_readS16_LE(uint8 reg);
-uint32 bme280_read24(uint8 reg);
+void bme280_readBurst(uint8 reg, uint8 *buf, uint8 len);
+
+/*
+ * Compensation runs in integer math by default, following the Bosch 32-bit
+ * reference code. Define BME280_FLOAT_COMPENSATION to use the double
+ * precision formulas instead; both paths return the same units.
+ */
+//#define BME280_FLOAT_COMPENSATION
+
+// calibration bursts, 0x88..0xA1 and 0xE1..0xE7
+#define BME280_CALIB_TP_LEN 26
+#define BME280_CALIB_H_LEN 7
+
+/**************************************************************************/
+/*!
+    @brief  calibration data
+*/
+/**************************************************************************/
+typedef struct {
+    uint16 dig_T1; ///< temperature compensation value
+    int16 dig_T2;  ///< temperature compensation value
+    int16 dig_T3;  ///< temperature compensation value
+
+    uint16 dig_P1; ///< pressure compensation value
+    int16 dig_P2;  ///< pressure compensation value
+    int16 dig_P3;  ///< pressure compensation value
+    int16 dig_P4;  ///< pressure compensation value
+    int16 dig_P5;  ///< pressure compensation value
+    int16 dig_P6;  ///< pressure compensation value
+    int16 dig_P7;  ///< pressure compensation value
+    int16 dig_P8;  ///< pressure compensation value
+    int16 dig_P9;  ///< pressure compensation value
+
+    uint8 dig_H1; ///< humidity compensation value
+    int16 dig_H2; ///< humidity compensation value
+    uint8 dig_H3; ///< humidity compensation value
+    int16 dig_H4; ///< humidity compensation value
+    int16 dig_H5; ///< humidity compensation value
+    int8 dig_H6;  ///< humidity compensation value
+} bme280_calib_t;
+
+typedef struct {
+    uint8 chipId; ///< BME280_REGISTER_CHIPID the parameters belong to
+    bme280_calib_t calib;
+} bme280_nv_calib_t;
+
+// press_msb..hum_lsb, 0xF7..0xFE
+#define BME280_DATA_LEN 8
+
+typedef struct {
+    int32 adc_P;
+    int32 adc_T;
+    int32 adc_H;
+} bme280_raw_t;
+
+typedef struct {
+    int16 temperature; // 0.01 degC
+    uint16 humidity;   // 0.01 %RH
+    uint32 pressure;   // Pa
+} bme280_data_t;
 
 extern bool BME280Init(void);
-extern float bme280_readTemperature(void);
-extern float bme280_readHumidity(void);
-extern float bme280_readPressure(void);
-extern void bme280_takeForcedMeasurement(void);
+extern bool bme280_readAll(bme280_raw_t *raw);
+extern void bme280_compensate(const bme280_raw_t *raw, bme280_data_t *data);
+extern void bme280_triggerForcedMeasurement(void);
+extern uint16 bme280_measurementTimeMs(void);
+extern bool bme280_setProfile(uint8 profile);
+extern uint16 bme280_sampleChargeNc(void);
 
 /**************************************************************************/
 /*!
@@ -75,6 +128,20 @@ enum standby_duration {
     STANDBY_MS_1000 = 0x05 //0b101
 };
 
+/**************************************************************************/
+/*!
+      @brief  sampling profiles, oversampling T/P/H and IIR filter
+*/
+/**************************************************************************/
+enum bme280_profile {
+    BME280_PROFILE_ULTRA_LOW_POWER   = 0x00, // x1/x1/x1, filter off
+    BME280_PROFILE_WEATHER_STATION   = 0x01, // x2/x4/x2, filter x4
+    BME280_PROFILE_INDOOR_NAVIGATION = 0x02, // x2/x16/x1, filter x16
+    BME280_PROFILE_COUNT
+};
+
+#define BME280_PROFILE_DEFAULT BME280_PROFILE_INDOOR_NAVIGATION
+
 /*!
  *  @brief Register addresses
  */
@@ -94,6 +94,9 @@
 #define HAL_NV_DMA_CH              0
 #define HAL_DMA_CH_RX              3
 #define HAL_DMA_CH_TX              4
+#define HAL_SPI_DMA_CH_RX          1
+#define HAL_SPI_DMA_CH_TX          2
+#define HAL_ADC_DMA_CH             2 // shared with SPI tx, neither returns with the channel armed
 
 #define HAL_NV_DMA_GET_DESC()      HAL_DMA_GET_DESC0()
 #define HAL_NV_DMA_SET_ADDR(a)     HAL_DMA_SET_ADDR_DESC0((a))
@@ -0,0 +1,141 @@
+/**************************************************************************************************
+  LDR divider to ZCL illuminance
+
+  The LDR resistance follows R ~ lux^-gamma, so log(lux) is close to a
+  straight line over log(raw ADC) for most of the range. The curve below
+  is piecewise linear in that log domain, a per device offset and gain
+  on top take up the LDR and resistor spread.
+
+  Default points: GL55xx (10 kOhm at 10 lx, gamma 0.7) over a 10 kOhm
+  resistor, AVDD reference, 14 bit.
+**************************************************************************************************/
+#include "ldr.h"
+#include "Debug.h"
+#include "hal_adc.h"
+#include "hal_board.h"
+#include "hal_delay.h"
+#include "utils.h"
+
+#define LDR_POWER_ON() HAL_TURN_ON_LED4()
+#define LDR_POWER_OFF() HAL_TURN_OFF_LED4()
+
+static const struct {
+  uint16 log2Raw; // log2(raw ADC) in Q12
+  uint16 value;   // 10000 * log10(lux) + 1
+} ldr_curve[] = {
+  {40960, 0},     // 1024, 0.6 lx
+  {45056, 3185},  // 2048, 2 lx
+  {49152, 10001}, // 4096, 10 lx
+  {51548, 16817}, // 6144, 48 lx
+  {52459, 22074}, // 7168, 161 lx
+  {53060, 31306}  // 7936, 1350 lx
+};
+
+#define LDR_CURVE_COUNT (sizeof(ldr_curve) / sizeof(ldr_curve[0]))
+
+uint32 ldr_excitationChargeNc = 0; // diagnostics, charge drawn by the divider since boot
+
+static uint16 ldr_settleUs = LDR_SETTLE_MAX_US;
+
+/**
+ * Power the divider and sample it until two readings agree, the time it
+ * took is the settle time of every following ldr_read
+ * @return uint16 settle time in us, LDR_SETTLE_MAX_US if it never settled
+ */
+uint16 ldr_measureSettleUs(void) {
+  uint16 last = 0xFFFF;
+  uint16 sample;
+  uint16 settleUs = 0;
+  
+  HalAdcSetReference(HAL_ADC_REF_AVDD);
+  LDR_POWER_ON();
+  while (settleUs < LDR_SETTLE_MAX_US) {
+    HalDelayUs(LDR_SETTLE_STEP_US);
+    settleUs += LDR_SETTLE_STEP_US;
+    sample = HalAdcRead(LUMOISITY_PIN, HAL_ADC_RESOLUTION_10);
+    if (last != 0xFFFF && (sample > last ? sample - last : last - sample) <= LDR_SETTLE_TOLERANCE) {
+      break;
+    }
+    last = sample;
+  }
+  LDR_POWER_OFF();
+  
+  // the 10 bit conversions between the steps count as margin
+  ldr_settleUs = settleUs;
+  ldr_excitationChargeNc += ((uint32)LDR_FULL_SCALE_UA * settleUs) / 1000;
+  LREP("[LDR] settle %d us\r\n", settleUs);
+  return settleUs;
+}
+
+/**
+ * One excitation: power, settle, sample, power off
+ * @return uint16 median of LDR_SAMPLES 14 bit readings
+ */
+uint16 ldr_read(void) {
+  uint16 raw;
+  uint16 onUs = ldr_settleUs + LDR_SAMPLES * LDR_CONVERSION_US;
+  
+  LDR_POWER_ON();
+  HalDelayUs(ldr_settleUs);
+  raw = adcReadSampled(LUMOISITY_PIN, HAL_ADC_RESOLUTION_14, HAL_ADC_REF_AVDD, LDR_SAMPLES, ADC_REDUCE_MEDIAN);
+  LDR_POWER_OFF();
+  
+  // the current follows the voltage over the fixed resistor, that is the reading
+  ldr_excitationChargeNc += ((uint32)raw * LDR_FULL_SCALE_UA / 8192 * onUs) / 1000;
+  return raw;
+}
+
+/**
+ * Raw ADC to ZCL illuminance MeasuredValue
+ * @param raw 14 bit ADC reading of the divider
+ * @param offset calibration offset in ZCL units
+ * @param gain calibration gain, Q12
+ * @return uint16 10000 * log10(lux) + 1, 0 if too dark
+ */
+uint16 ldr_toZclIlluminance(uint16 raw, int16 offset, uint16 gain) {
+  uint16 x = (uint16)log2Q12(raw);
+  uint8 i = 1;
+  int32 value;
+  
+  if (raw == 0 || x <= ldr_curve[0].log2Raw) {
+    return 0;
+  }
+  // the last segment is extended towards saturation
+  while (i + 1 < LDR_CURVE_COUNT && x > ldr_curve[i].log2Raw) {
+    i++;
+  }
+  value = ldr_curve[i - 1].value +
+          ((int32)(ldr_curve[i].value - ldr_curve[i - 1].value) * (x - ldr_curve[i - 1].log2Raw)) /
+              (ldr_curve[i].log2Raw - ldr_curve[i - 1].log2Raw);
+  // value is positive here, up to 34k on the extended segment, times gain needs all 32 bits
+  value = (int32)(((uint32)value * gain) >> 12) + offset;
+  
+  if (value <= 0) {
+    return 0;
+  }
+  return value > 0xFFFE ? 0xFFFE : (uint16)value;
+}
+
+/**
+ * Move the offset towards a reference reading of the same light
+ * @param ldrValue calibrated LDR reading
+ * @param referenceValue e.g. BH1750 reading
+ * @param offset current offset
+ * @return int16 new offset
+ */
+int16 ldr_calibrate(uint16 ldrValue, uint16 referenceValue, int16 offset) {
+  int32 next;
+  
+  // out of range on either side tells nothing about the offset
+  if (ldrValue == 0 || ldrValue == 0xFFFE || referenceValue == 0) {
+    return offset;
+  }
+  next = offset + ((int32)referenceValue - ldrValue) / LDR_CALIB_WEIGHT;
+  if (next > LDR_CALIB_OFFSET_MAX) {
+    next = LDR_CALIB_OFFSET_MAX;
+  } else if (next < -LDR_CALIB_OFFSET_MAX) {
+    next = -LDR_CALIB_OFFSET_MAX;
+  }
+  LREP("[LDR] offset %d -> %d\r\n", offset, (int16)next);
+  return (int16)next;
+}
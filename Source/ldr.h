@@ -0,0 +1,27 @@
+#ifndef LDR_H
+#define LDR_H
+
+// calibration gain in Q12, 4096 keeps the curve slope
+#define LDR_CALIB_GAIN_DEFAULT 4096
+#define LDR_CALIB_OFFSET_DEFAULT 0
+
+// auto calibration moves the offset by 1/LDR_CALIB_WEIGHT of the error per reading
+#define LDR_CALIB_WEIGHT 8
+#define LDR_CALIB_OFFSET_MAX 20000 // 2 decades
+
+// the divider hangs on P1.1 (LED4), powered only while it is sampled
+#define LDR_SAMPLES 5
+#define LDR_CONVERSION_US 132 // 14 bit
+#define LDR_SETTLE_STEP_US 20
+#define LDR_SETTLE_MAX_US 2000
+#define LDR_SETTLE_TOLERANCE 2 // 10 bit counts
+#define LDR_FULL_SCALE_UA 300  // divider current at full scale, 3 V over 10 kOhm
+
+extern uint32 ldr_excitationChargeNc;
+
+extern uint16 ldr_measureSettleUs(void);
+extern uint16 ldr_read(void);
+extern uint16 ldr_toZclIlluminance(uint16 raw, int16 offset, uint16 gain);
+extern int16 ldr_calibrate(uint16 ldrValue, uint16 referenceValue, int16 offset);
+
+#endif
@@ -2,6 +2,11 @@
 #define NV_INIT
 #define NV_RESTORE
 
+// NV items of the application, all of them here so they can't collide
+#define NW_APP_CONFIG   0x0401
+#define NW_BME280_CALIB 0x0402 // trimming parameters, see bme280spi.c
+#define NW_APP_METERING 0x0403 // summation, written in batches by metering.c
+
 
 #define TP2_LEGACY_ZC
 //patch sdk
@@ -65,6 +70,9 @@
 
 #define HAL_I2C_RETRY_CNT 1
 
+// log HalDelayUs accuracy against the sleep timer at boot
+//#define HAL_DELAY_SELF_TEST
+
 
 #ifdef DO_DEBUG_UART
 #define HAL_UART TRUE
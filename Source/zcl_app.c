@@ -7,7 +7,6 @@
 #include "ZDApp.h"
 #include "ZDNwkMgr.h"
 #include "ZDObject.h"
-#include "math.h"
 
 #include "nwk_util.h"
 #include "zcl.h"
@@ -27,6 +26,7 @@
 
 /* HAL */
 #include "hal_adc.h"
+#include "hal_delay.h"
 #include "hal_drivers.h"
 #include "hal_i2c.h"
 #include "hal_key.h"
@@ -34,32 +34,22 @@
 
 #include "bme280spi.h"
 #include "bh1750.h"
+#include "ldr.h"
 #include "battery.h"
 #include "commissioning.h"
 #include "factory_reset.h"
+#include "occupancy.h"
+#include "sampling.h"
+#include "sensors.h"
 #include "utils.h"
 #include "version.h"
+#include "wake.h"
 
 /*********************************************************************
  * MACROS
  */
-#define HAL_KEY_P0_EDGE_BITS HAL_KEY_BIT0
-
 #define HAL_KEY_CODE_RELEASE_KEY HAL_KEY_CODE_NOKEY
 
-#define IO_PUP_BH1750()                        \
-    do {                                       \
-        IO_PUD_PORT(OCM_CLK_PORT, IO_PUP);     \
-        IO_PUD_PORT(OCM_DATA_PORT, IO_PUP);    \
-    } while (0) 
- 
-
-#define IO_PDN_BH1750()                     \
-    do {                                        \
-        IO_PUD_PORT(OCM_CLK_PORT, IO_PDN);      \
-        IO_PUD_PORT(OCM_DATA_PORT, IO_PDN);     \
-    } while (0)
-
 /*********************************************************************
  * CONSTANTS
  */
@@ -83,21 +73,11 @@ byte zclApp_TaskID;
  * LOCAL VARIABLES
  */
 
-static uint8 currentSensorsReadingPhase = 0;
-
-uint8 report = 0;
-uint8 power = 0;
 bool bmeDetect = 0;
 bool LumDetect = 0;
-uint8 contDetect = 0;
 uint8 bh1750Detect = 0;
-uint8 BH1750_mode = ONE_TIME_HIGH_RES_MODE;
 
-uint16 temp_IlluminanceSensor_MeasuredValue;
-uint16 temp_bh1750IlluminanceSensor_MeasuredValue;
-uint16 temp_Temperature_Sensor_MeasuredValue;
-uint16 temp_PressureSensor_MeasuredValue;
-uint16 temp_HumiditySensor_MeasuredValue;
+int16 savedLdrCalibOffset;
 
 afAddrType_t inderect_DstAddr = {.addrMode = (afAddrMode_t)AddrNotPresent, .endPoint = 0, .addr.shortAddr = 0};
 
@@ -105,7 +85,14 @@ afAddrType_t inderect_DstAddr = {.addrMode = (afAddrMode_t)AddrNotPresent, .endP
  * LOCAL FUNCTIONS
  */
 static void zclApp_HandleKeys(byte shift, byte keys);
-static void zclApp_Report(void);
+static void zclApp_HandleContact(void);
+static void zclApp_HandleMotionEdge(void);
+static void zclApp_ReportMotion(uint32 edgeStamp);
+static void zclApp_PirPower(bool on);
+static void zclApp_OccupancyChanged(void);
+static void zclApp_OccupancyRearmed(void);
+static void zclApp_ControlLights(bool on);
+static void zclApp_ApplyContactMode(void);
 
 static void zclApp_BasicResetCB(void);
 static void zclApp_RestoreAttributesFromNV(void);
@@ -113,10 +100,61 @@ static void zclApp_SaveAttributesToNV(void);
 
 static ZStatus_t zclApp_ReadWriteAuthCB(afAddrType_t *srcAddr, zclAttrRec_t *pAttr, uint8 oper);
 
-static void zclApp_ReadSensors(void);
+static bool zclApp_StartCycle(bool all);
+static void zclApp_CycleDone(void);
+static bool zclApp_ProbeBME280(void);
 static void zclApp_ReadBME280(void);
+static void zclApp_ApplyBME280Profile(void);
+static bool zclApp_ProbeLdr(void);
 static void zclApp_ReadLumosity(void);
+static bool zclApp_LdrNeeded(void);
+static bool zclApp_ProbeBH1750(void);
 static void zclApp_bh1750ReadLumosity(void);
+static void zclApp_CalibrateLdr(void);
+static void zclApp_ApplyMeasureInterval(void);
+static void zclApp_MeasureWithin(uint16 seconds);
+static void zclApp_MeasureActivity(void);
+
+/*********************************************************************
+ * Sensors of a measurement cycle, read in table order so the LDR
+ * reading is there when the BH1750 calibrates it
+ */
+static CONST zclSensor_t zclApp_Sensors[] = {
+    // probe, power up, trigger, conversion time, read, power down, period
+    {zclApp_ProbeLdr, NULL, NULL, NULL, zclApp_ReadLumosity, NULL, 0},
+    {zclApp_ProbeBME280, NULL, bme280_triggerForcedMeasurement, bme280_measurementTimeMs, zclApp_ReadBME280, NULL, 0},
+    {zclApp_ProbeBH1750, NULL, bh1750_startMeasurement, bh1750_measurementTimeMs, zclApp_bh1750ReadLumosity, bh1850_PowerDown, 0},
+    {NULL, NULL, NULL, NULL, zclBattery_Measure, NULL, APP_BATTERY_PERIOD}
+};
+
+/*********************************************************************
+ * Periodic work, indexed by APP_WAKE_*
+ */
+static CONST zclWakeItem_t zclApp_WakeItems[] = {
+    // event, period, slack
+    {APP_REPORT_MEASURE_EVT, 0, APP_MEASURE_SLACK}, // zclSampling_Interval
+    {APP_REPORT_EVT, APP_REPORT_DELAY, APP_REPORT_SLACK},
+    {APP_POLL_EVT, APP_POLL_PERIOD, APP_POLL_SLACK},
+    {APP_METERING_EVT, 0, APP_METERING_SLACK} // while pulses come in
+};
+
+/*********************************************************************
+ * Occupancy of endpoint 3, follows the ZCL PIR attributes
+ */
+static CONST zclOccupancy_t zclApp_Occupancy = {
+    &zclApp_Occupied,
+    &zclApp_Config.PirOccupiedToUnoccupiedDelay,
+    &zclApp_Config.PirUnoccupiedToOccupiedDelay,
+    &zclApp_Config.PirUnoccupiedToOccupiedThreshold,
+    zclApp_PirPower,
+    zclApp_OccupancyChanged,
+    zclApp_OccupancyRearmed
+};
+
+static uint32 zclApp_MotionStamp = 0; // sleep timer at the last PIR edge
+static bool zclApp_LightsOn = FALSE;  // endpoint 3 switched the bound lights on
+static bool zclApp_MeterWritten = FALSE; // summation set to the meter reading
+static uint8 zclApp_ContactMode = 0xFF;  // APP_CONTACT_MODE_* the input is set up for
 
 /*********************************************************************
  * ZCL General Profile Callback table
@@ -133,42 +171,22 @@ static zclGeneral_AppCallbacks_t zclApp_CmdCallbacks = {
 };
 
 void zclApp_Init(byte task_id) {
+#ifdef HAL_DELAY_SELF_TEST
+    HalDelaySelfTest();
+#endif
     zclApp_RestoreAttributesFromNV();
-      
-    IO_IMODE_PORT_PIN(LUMOISITY_PORT, LUMOISITY_PIN, IO_TRI); // tri state p0.7 (lumosity pin)
-    HAL_TURN_ON_LED4(); // p1.1 ON
-    zclApp_ReadLumosity();
-    HAL_TURN_OFF_LED4(); // p1.1 OFF
-    if (zclApp_IlluminanceSensor_MeasuredValue > 1000){
-      LumDetect = 1;
-    } else {
-      IO_IMODE_PORT_PIN(LUMOISITY_PORT, LUMOISITY_PIN, IO_PUD); // Pullup/pulldn input p0.7 (lumosity pin)
-      LumDetect = 0;      
-    }
-
-    LREP("P0_0 %d\r\n", P0_0);
-    contDetect = P0_0;
-    zclApp_Magnet_OnOff = contDetect;
-    if (contDetect == 1){
-      P2INP &= ~HAL_KEY_BIT5; // pull up
-      MicroWait(50);
-      PICTL |= HAL_KEY_P0_EDGE_BITS; // set falling edge on port
-    } else {
-      P2INP |= HAL_KEY_BIT5; // pull down
-      MicroWait(50);
-      PICTL &= ~(HAL_KEY_P0_EDGE_BITS);     
-    }
     
     P1SEL &= ~BV(0); // Set P1_0 to GPIO
     P1DIR |= BV(0); // P1_0 output
     P1 |=  BV(0);   // power on DD
         
-    bmeDetect = BME280Init();
-    
+    // BH1750 integrates while the network comes up, well over BH1750_PROBE_TIME_MS
+    // before the first measurement cycle probes the sensors
     HalI2CInit();
-    IO_PUP_BH1750();
-    bh1750Detect = bh1750_init(BH1750_mode);
-    IO_PDN_BH1750(); 
+    bh1750_startProbe();
+    
+    zclApp_ApplyMeasureInterval();
+    zclSampling_Init(zclApp_Config.MeasureIntervalMin);
     
     // this is important to allow connects throught routers
     // to make this work, coordinator should be compiled with this flag #define TP2_LEGACY_ZC
@@ -176,6 +194,9 @@ void zclApp_Init(byte task_id) {
 
     zclApp_TaskID = task_id;
 
+    zclMetering_Init(zclApp_SecondEP.EndPoint, NW_APP_METERING);
+    zclApp_ApplyContactMode();
+
     zclGeneral_RegisterCmdCallbacks(1, &zclApp_CmdCallbacks);
     zcl_registerAttrList(zclApp_FirstEP.EndPoint, zclApp_AttrsFirstEPCount, zclApp_AttrsFirstEP);
     bdb_RegisterSimpleDescriptor(&zclApp_FirstEP);
@@ -189,22 +210,44 @@ void zclApp_Init(byte task_id) {
     zcl_registerAttrList(zclApp_FourthEP.EndPoint, zclApp_AttrsFourthEPCount, zclApp_AttrsFourthEP);
     bdb_RegisterSimpleDescriptor(&zclApp_FourthEP);
     
+    zcl_registerReadWriteCB(zclApp_FirstEP.EndPoint, NULL, zclApp_ReadWriteAuthCB);
+    zcl_registerReadWriteCB(zclApp_SecondEP.EndPoint, NULL, zclApp_ReadWriteAuthCB);
     zcl_registerReadWriteCB(zclApp_ThirdEP.EndPoint, NULL, zclApp_ReadWriteAuthCB);
 
+    zclReporting_Init(zclApp_ReportingEntries, zclApp_ReportingEntriesCount);
+    zclSensors_Init(zclApp_Sensors, sizeof(zclApp_Sensors) / sizeof(zclApp_Sensors[0]), zclApp_TaskID,
+                    APP_READ_SENSORS_EVT, zclApp_CycleDone);
+
     zcl_registerForMsg(zclApp_TaskID);
 
     // Register for all key events - This app will handle all key events
     RegisterForKeys(zclApp_TaskID);
+    // the PIR skips the key debounce and the key message
+    HalKeyInputConfig(HAL_KEY_PORT1, APP_PIR_PIN, HAL_KEY_INPUT_FIRST_EDGE, 0, zclApp_TaskID, APP_MOTION_EDGE_EVT);
+    zclOccupancy_Init(&zclApp_Occupancy, zclApp_TaskID, APP_OCCUPANCY_EVT);
     LREP("Started build %s \r\n", zclApp_DateCodeNT);
 
-    osal_start_reload_timer(zclApp_TaskID, APP_REPORT_EVT, APP_REPORT_DELAY);
-    osal_start_reload_timer(zclApp_TaskID, APP_REPORT_MEASURE_EVT, 10000);
+    zclWake_Init(zclApp_WakeItems, sizeof(zclApp_WakeItems) / sizeof(zclApp_WakeItems[0]), zclApp_TaskID, APP_WAKE_EVT);
+    zclWake_Schedule(APP_WAKE_MEASURE, (uint32)zclSampling_Interval * 1000);
 }
 
 uint16 zclApp_event_loop(uint8 task_id, uint16 events) {
     afIncomingMSGPacket_t *MSGpkt;
 
     (void)task_id; // Intentionally unreferenced parameter
+    // first, an occupancy report may be waiting for it
+    if (events & APP_MOTION_EDGE_EVT) {
+        LREPMaster("APP_MOTION_EDGE_EVT\r\n");
+        zclApp_HandleMotionEdge();
+        return (events ^ APP_MOTION_EDGE_EVT);
+    }
+
+    if (events & APP_CONTACT_EVT) {
+        LREPMaster("APP_CONTACT_EVT\r\n");
+        zclApp_HandleContact();
+        return (events ^ APP_CONTACT_EVT);
+    }
+
     if (events & SYS_EVENT_MSG) {
         while ((MSGpkt = (afIncomingMSGPacket_t *)osal_msg_receive(zclApp_TaskID))) {
             switch (MSGpkt->hdr.event) {
@@ -230,73 +273,76 @@ uint16 zclApp_event_loop(uint8 task_id, uint16 events) {
     
     if (events & APP_REPORT_MEASURE_EVT) {
         LREPMaster("APP_REPORT_MEASURE_EVT\r\n");
-        report = 0;
-//        zclApp_Report();
-        zclApp_ReadSensors();
+        // keeps the measurements going, the end of the cycle picks the actual interval
+        zclWake_Schedule(APP_WAKE_MEASURE, (uint32)zclSampling_Interval * 1000);
+        // a report in the same wakeup reads all sensors anyway
+        if (!(events & APP_REPORT_EVT)) {
+            zclApp_StartCycle(FALSE);
+        }
         return (events ^ APP_REPORT_MEASURE_EVT);
     }
     
     if (events & APP_REPORT_EVT) {
         LREPMaster("APP_REPORT_EVT\r\n");
-        report = 1;
-        zclApp_Report();
-//        zclApp_ReadSensors();
+        HalLedSet(HAL_LED_1, HAL_LED_MODE_BLINK);
+        if (zclApp_Config.ContactMode == APP_CONTACT_MODE_PULSES) {
+            zclMetering_Report();
+        }
+        if (!zclApp_StartCycle(TRUE)) {
+            // the running cycle is done after its longest conversion
+            osal_start_timerEx(zclApp_TaskID, APP_REPORT_EVT, 500);
+        }
         return (events ^ APP_REPORT_EVT);
     }
 
+    if (events & APP_WAKE_EVT) {
+        LREPMaster("APP_WAKE_EVT\r\n");
+        zclWake_Process();
+        return (events ^ APP_WAKE_EVT);
+    }
+
+    if (events & APP_POLL_EVT) {
+        LREPMaster("APP_POLL_EVT\r\n");
+        zclCommissioning_Poll();
+        return (events ^ APP_POLL_EVT);
+    }
+
     if (events & APP_READ_SENSORS_EVT) {
         LREPMaster("APP_READ_SENSORS_EVT\r\n");
-        zclApp_ReadSensors();
+        zclSensors_Process();
         return (events ^ APP_READ_SENSORS_EVT);
     }
         
-    if (events & APP_MOTION_ON_EVT) {
-        LREPMaster("APP_MOTION_ON_EVT\r\n");
-        P1 &= ~BV(0);   // power off motion
-        P1DIR &= ~BV(0); // P1_0 input
-        osal_start_timerEx(zclApp_TaskID, APP_MOTION_DELAY_EVT, zclApp_Config.PirOccupiedToUnoccupiedDelay * 1000);
-        LREPMaster("START_DELAY\r\n");
-        //report
-        zclApp_Occupied = 1;
-        bdb_RepChangedAttrValue(zclApp_ThirdEP.EndPoint, OCCUPANCY, ATTRID_MS_OCCUPANCY_SENSING_CONFIG_OCCUPANCY);
-        
-        return (events ^ APP_MOTION_ON_EVT);
+    if (events & APP_METERING_EVT) {
+        uint32 next;
+        LREPMaster("APP_METERING_EVT\r\n");
+        // the counter wakes us up again once pulses come in after standing still
+        next = zclMetering_Process(HalKeyInputTake(HAL_KEY_PORT0));
+        if (next != 0) {
+            zclWake_Schedule(APP_WAKE_METERING, next);
+        }
+        return (events ^ APP_METERING_EVT);
     }
-    
-    if (events & APP_MOTION_OFF_EVT) {
-        LREPMaster("APP_MOTION_OFF_EVT\r\n");
-        //report    
-        zclApp_Occupied = 0;
-        bdb_RepChangedAttrValue(zclApp_ThirdEP.EndPoint, OCCUPANCY, ATTRID_MS_OCCUPANCY_SENSING_CONFIG_OCCUPANCY);
 
-        return (events ^ APP_MOTION_OFF_EVT);
-    }
-    
-    if (events & APP_MOTION_DELAY_EVT) {
-        LREPMaster("APP_MOTION_DELAY_EVT\r\n");
-        power = 2;
-        P1DIR |=  BV(0); // P1_0 output
-        P1 |=  BV(0);   // power on motion
-        
-        return (events ^ APP_MOTION_DELAY_EVT);
-    }
-    
-    if (events & APP_CONTACT_DELAY_EVT) {
-        LREPMaster("APP_CONTACT_DELAY_EVT\r\n");
-        bdb_RepChangedAttrValue(zclApp_SecondEP.EndPoint, ONOFF, ATTRID_ON_OFF);
+    if (events & APP_OCCUPANCY_EVT) {
+        LREPMaster("APP_OCCUPANCY_EVT\r\n");
+        zclOccupancy_Process();
 
-        return (events ^ APP_CONTACT_DELAY_EVT);
-    }
-    
-    if (events & APP_BH1750_DELAY_EVT) {
-        LREPMaster("APP_BH1750_DELAY_EVT\r\n");
-        zclApp_bh1750ReadLumosity();
-        
-        return (events ^ APP_BH1750_DELAY_EVT);
+        return (events ^ APP_OCCUPANCY_EVT);
     }
     
     if (events & APP_SAVE_ATTRS_EVT) {
         LREPMaster("APP_SAVE_ATTRS_EVT\r\n");
+        if (bmeDetect == 1) {
+          zclApp_ApplyBME280Profile();
+        }
+        zclApp_ApplyMeasureInterval();
+        zclApp_MeasureWithin(zclApp_Config.MeasureIntervalMax);
+        zclApp_ApplyContactMode();
+        if (zclApp_MeterWritten) {
+            zclApp_MeterWritten = FALSE;
+            zclMetering_Save();
+        }
         zclApp_SaveAttributesToNV();
         
         return (events ^ APP_SAVE_ATTRS_EVT);
@@ -316,41 +362,8 @@ static void zclApp_HandleKeys(byte portAndAction, byte keyCode) {
 
     bool contact = portAndAction & HAL_KEY_PRESS ? TRUE : FALSE;
     uint8 endPoint = 0;
-    if (portAndAction & HAL_KEY_PORT0) {
-        LREPMaster("Key press PORT0\r\n");
-//        P2INP ^= HAL_KEY_BIT5; // flip pull up/down
-        osal_start_timerEx(zclApp_TaskID, APP_CONTACT_DELAY_EVT, 500); //adaptive contact
-        HalLedSet(HAL_LED_1, HAL_LED_MODE_BLINK);
-        if (contact){
-          P2INP &= ~HAL_KEY_BIT5; // pull up
-          zclApp_Magnet_OnOff = contact;
-        } else {
-          P2INP |= HAL_KEY_BIT5; // pull down
-          zclApp_Magnet_OnOff = contact;
-        }
-        
-    } else if (portAndAction & HAL_KEY_PORT1) {     
-        LREPMaster("Key press PORT1\r\n");
-//          P2INP ^= HAL_KEY_BIT6; // flip down/up
-        if (!contact) {
-          P2INP |= HAL_KEY_BIT6;  // pull down
-        } else {
-          P2INP &= ~HAL_KEY_BIT6; // pull up
-        }
-        HalLedSet(HAL_LED_1, HAL_LED_MODE_BLINK);
-        if (power == 0){
-          if (contact) {
-            osal_start_timerEx(zclApp_TaskID, APP_MOTION_ON_EVT, 100);
-            osal_start_timerEx(zclApp_TaskID, APP_REPORT_MEASURE_EVT, 100);
-          }
-        } else {
-          if (power == 1){
-            osal_start_timerEx(zclApp_TaskID, APP_MOTION_OFF_EVT, 100); //adaptive motion
-          }
-          power = power - 1;
-        }
-        LREP("power=%d\r\n", power);
-     } else if (portAndAction & HAL_KEY_PORT2) {
+    // the contact comes as APP_CONTACT_EVT, see zclApp_ApplyContactMode
+    if (portAndAction & HAL_KEY_PORT2) {
        LREPMaster("Key press PORT2\r\n");
        if (contact) {
           osal_start_timerEx(zclApp_TaskID, APP_REPORT_EVT, 200);
@@ -363,182 +376,305 @@ static void zclApp_HandleKeys(byte portAndAction, byte keyCode) {
      } 
 }
 
-static void zclApp_ReadSensors(void) {
-    LREP("currentSensorsReadingPhase %d\r\n", currentSensorsReadingPhase);
-    /**
-     * FYI: split reading sensors into phases, so single call wouldn't block processor
-     * for extensive ammount of time
-     * */
-  if (report == 1) {
-    switch (currentSensorsReadingPhase++) {
-    case 0:
-      if (report == 1){
-        HalLedSet(HAL_LED_1, HAL_LED_MODE_BLINK);
-      }
-      if (LumDetect == 1){
-        HAL_TURN_ON_LED4(); // p1.1 ON
-        zclApp_ReadLumosity();
-        HAL_TURN_OFF_LED4(); // p1.1 OFF
-      }
-        break;
-    case 1:
-      if (report == 1){
-        zclBattery_Report();
-      }  
-        break;
-    case 2:
-      if (bmeDetect == 1){
-          zclApp_ReadBME280();
-      }
-        break;
-    case 3:
-      if (bh1750Detect == 1){
-        IO_PUP_BH1750();
-        bh1850_Write(BH1750_POWER_ON);
-        bh1850_Write(BH1750_mode);
-        IO_PDN_BH1750();
-        if (BH1750_mode == CONTINUOUS_LOW_RES_MODE || BH1750_mode == ONE_TIME_LOW_RES_MODE) {
-          osal_start_timerEx(zclApp_TaskID, APP_BH1750_DELAY_EVT, 30);
-        } else {
-          osal_start_timerEx(zclApp_TaskID, APP_BH1750_DELAY_EVT, 180);
-        }
-      }      
-        break;
-    default:
-        osal_stop_timerEx(zclApp_TaskID, APP_READ_SENSORS_EVT);
-        osal_clear_event(zclApp_TaskID, APP_READ_SENSORS_EVT);
-        currentSensorsReadingPhase = 0;
-        break;
-    }
-  }
-  if (report == 0){
-      if (report == 1){
-        HalLedSet(HAL_LED_1, HAL_LED_MODE_BLINK);
-      }
-      if (LumDetect == 1){
-        HAL_TURN_ON_LED4(); // p1.1 ON
-        zclApp_ReadLumosity();
-        HAL_TURN_OFF_LED4(); // p1.1 OFF
-      }
-      if (bmeDetect == 1){
-          zclApp_ReadBME280();
-      }
-      if (bh1750Detect == 1){
-        IO_PUP_BH1750();
-        bh1850_Write(BH1750_POWER_ON);
-        bh1850_Write(BH1750_mode);
-        IO_PDN_BH1750();
-        if (BH1750_mode == CONTINUOUS_LOW_RES_MODE || BH1750_mode == ONE_TIME_LOW_RES_MODE) {
-          osal_start_timerEx(zclApp_TaskID, APP_BH1750_DELAY_EVT, 30);
-        } else {
-          osal_start_timerEx(zclApp_TaskID, APP_BH1750_DELAY_EVT, 180);
+static void zclApp_HandleContact(void) {
+    // the bounces of this change are still to come, the attribute has the previous one
+    zclApp_Magnet_OnOff = HalKeyInputRead(HAL_KEY_PORT0, NULL, &zclApp_ContactBounces);
+    // the first edge goes out right away, the bounces after it don't wake us up
+    if (zclReporting_SendNow(zclApp_SecondEP.EndPoint, ONOFF, ATTRID_ON_OFF) != ZSuccess) {
+        zclReporting_Process();
+    }
+    zclApp_MeasureActivity();
+    HalLedSet(HAL_LED_1, HAL_LED_MODE_BLINK);
+    LREP("contact=%d bounces=%d\r\n", zclApp_Magnet_OnOff, zclApp_ContactBounces);
+}
+
+static void zclApp_HandleMotionEdge(void) {
+    bool motion = HalKeyInputRead(HAL_KEY_PORT1, &zclApp_MotionStamp, NULL);
+
+    zclOccupancy_Edge(motion);
+    HalLedSet(HAL_LED_1, HAL_LED_MODE_BLINK);
+    LREP("motion=%d state=%d\r\n", motion, zclOccupancy_State);
+}
+
+static void zclApp_OccupancyChanged(void) {
+    // the lights first, they don't wait for the coordinator
+    zclApp_ControlLights(zclApp_Occupied);
+    if (zclApp_Occupied) {
+        zclApp_ReportMotion(zclApp_MotionStamp);
+        zclSampling_Activity(zclApp_Config.MeasureIntervalMin);
+        zclWake_Schedule(APP_WAKE_MEASURE, 100);
+    } else {
+        zclReporting_Process();
+    }
+}
+
+static void zclApp_OccupancyRearmed(void) {
+    // the light's own off timer follows the new hold
+    if (zclApp_LightsOn && zclApp_Config.LightControl == APP_LIGHT_CONTROL_ON_TIMED_OFF) {
+        zclApp_ControlLights(TRUE);
+    }
+}
+
+static void zclApp_ControlLights(bool on) {
+    uint8 payload[5];
+    uint16 onTime;
+    uint8 len = 0;
+    uint8 cmd;
+
+    if (zclApp_Config.LightControl == APP_LIGHT_CONTROL_DISABLED) {
+        return;
+    }
+    if (!on) {
+        if (!zclApp_LightsOn || zclApp_Config.LightControl != APP_LIGHT_CONTROL_ON_OFF) {
+            // never switched on or it goes off by itself
+            zclApp_LightsOn = FALSE;
+            return;
         }
-      }
-  }
+        cmd = COMMAND_OFF;
+    } else if (!zclApp_LightsOn && bh1750Detect == 1 && zclApp_Config.LightIlluminanceMax != 0 &&
+               zclApp_bh1750IlluminanceSensor_MeasuredValue > zclApp_Config.LightIlluminanceMax) {
+        LREP("lights stay off, illuminance %d\r\n", zclApp_bh1750IlluminanceSensor_MeasuredValue);
+        return;
+    } else if (zclApp_Config.LightControl == APP_LIGHT_CONTROL_ON_TIMED_OFF) {
+        // 1/10 s, 0xFFFF would be forever
+        onTime = zclApp_Config.PirOccupiedToUnoccupiedDelay < 6553 ? zclApp_Config.PirOccupiedToUnoccupiedDelay * 10 : 0xFFFE;
+        payload[len++] = 0x00; // OnOffControl, accept when off as well
+        payload[len++] = LO_UINT16(onTime);
+        payload[len++] = HI_UINT16(onTime);
+        payload[len++] = 0x00; // OffWaitTime
+        payload[len++] = 0x00;
+        cmd = COMMAND_ON_WITH_TIMED_OFF;
+    } else {
+        cmd = COMMAND_ON;
+    }
+    zcl_SendCommand(zclApp_ThirdEP.EndPoint, &inderect_DstAddr, ONOFF, cmd, TRUE, ZCL_FRAME_CLIENT_SERVER_DIR, TRUE, 0,
+                    bdb_getZCLFrameCounter(), len, payload);
+    zclApp_LightsOn = on;
+}
+
+static void zclApp_PirPower(bool on) {
+    if (on) {
+        P1DIR |=  BV(0); // P1_0 output
+        P1 |=  BV(0);   // power on motion
+    } else {
+        P1 &= ~BV(0);   // power off motion
+        P1DIR &= ~BV(0); // P1_0 input
+    }
+}
+
+static void zclApp_ReportMotion(uint32 edgeStamp) {
+    uint32 ticks;
 
+    if (zclReporting_SendNow(zclApp_ThirdEP.EndPoint, OCCUPANCY, ATTRID_MS_OCCUPANCY_SENSING_CONFIG_OCCUPANCY) != ZSuccess) {
+        // no buffer, the BDB sends it a bit later
+        zclReporting_Process();
+        return;
+    }
+    ticks = (HalDelaySleepTimer() - edgeStamp) & HAL_DELAY_ST_MASK;
+    // saturates at 65 ms, 2147 ticks
+    zclApp_MotionLatency = ticks < 2147 ? (uint16)HAL_DELAY_TICKS_TO_US(ticks) : 0xFFFF;
+    zclApp_MotionLatencyMax = MAX(zclApp_MotionLatency, zclApp_MotionLatencyMax);
+    LREP("motion latency %d us\r\n", zclApp_MotionLatency);
 }
 
-static void zclApp_ReadLumosity(void) {
-    zclApp_IlluminanceSensor_MeasuredValueRawAdc = adcReadSampled(LUMOISITY_PIN, HAL_ADC_RESOLUTION_14, HAL_ADC_REF_AVDD, 5);
-    zclApp_IlluminanceSensor_MeasuredValue = zclApp_IlluminanceSensor_MeasuredValueRawAdc;
-    uint16 illum = 0;
-    if (temp_IlluminanceSensor_MeasuredValue > zclApp_IlluminanceSensor_MeasuredValue){
-      illum = (temp_IlluminanceSensor_MeasuredValue - zclApp_IlluminanceSensor_MeasuredValue);
+static void zclApp_ApplyContactMode(void) {
+    if (zclApp_Config.ContactMode == zclApp_ContactMode) {
+        // the counter keeps its pulses
+        return;
+    }
+    zclApp_ContactMode = zclApp_Config.ContactMode;
+    if (zclApp_ContactMode == APP_CONTACT_MODE_PULSES) {
+        HalKeyInputConfig(HAL_KEY_PORT0, APP_CONTACT_PIN, HAL_KEY_INPUT_COUNT, APP_PULSE_HOLDOFF_MS, zclApp_TaskID,
+                          APP_METERING_EVT);
     } else {
-      illum = (zclApp_IlluminanceSensor_MeasuredValue - temp_IlluminanceSensor_MeasuredValue);
+        // count what came in before the switch
+        zclMetering_Process(HalKeyInputTake(HAL_KEY_PORT0));
+        HalKeyInputConfig(HAL_KEY_PORT0, APP_CONTACT_PIN, HAL_KEY_INPUT_FIRST_EDGE, APP_CONTACT_GLITCH_MS, zclApp_TaskID,
+                          APP_CONTACT_EVT);
+    }
+    zclApp_Magnet_OnOff = HalKeyInputRead(HAL_KEY_PORT0, NULL, NULL);
+    LREP("contact mode=%d level=%d\r\n", zclApp_ContactMode, zclApp_Magnet_OnOff);
+}
+
+static bool zclApp_StartCycle(bool all) {
+    if (zclSensors_Busy()) {
+        return FALSE;
+    }
+    return zclSensors_Start(all);
+}
+
+static void zclApp_CycleDone(void) {
+    // all readings are in, the BDB sends one frame per changed cluster
+    zclReporting_Process();
+    zclSampling_Update(zclApp_Config.MeasureIntervalMin, zclApp_Config.MeasureIntervalMax);
+    zclWake_Schedule(APP_WAKE_MEASURE, (uint32)zclSampling_Interval * 1000);
+}
+
+static void zclApp_ApplyMeasureInterval(void) {
+    // the floor is never 0, a ceiling below it moves up rather than the floor down
+    if (zclApp_Config.MeasureIntervalMin == 0) {
+        zclApp_Config.MeasureIntervalMin = APP_MEASURE_INTERVAL_MIN_DEFAULT;
     }
-    if (illum > 100 || report == 1){
-      temp_IlluminanceSensor_MeasuredValue = zclApp_IlluminanceSensor_MeasuredValue;
-      bdb_RepChangedAttrValue(zclApp_FirstEP.EndPoint, ILLUMINANCE, ATTRID_MS_ILLUMINANCE_MEASURED_VALUE);
+    if (zclApp_Config.MeasureIntervalMin > APP_MEASURE_INTERVAL_LIMIT) {
+        zclApp_Config.MeasureIntervalMin = APP_MEASURE_INTERVAL_LIMIT;
     }
-    LREP("IlluminanceSensor_MeasuredValue value=%d\r\n", zclApp_IlluminanceSensor_MeasuredValue);
+    if (zclApp_Config.MeasureIntervalMax > APP_MEASURE_INTERVAL_LIMIT) {
+        zclApp_Config.MeasureIntervalMax = APP_MEASURE_INTERVAL_LIMIT;
+    }
+    if (zclApp_Config.MeasureIntervalMax < zclApp_Config.MeasureIntervalMin) {
+        zclApp_Config.MeasureIntervalMax = zclApp_Config.MeasureIntervalMin;
+    }
+    LREP("Measure interval min=%d max=%d\r\n", zclApp_Config.MeasureIntervalMin, zclApp_Config.MeasureIntervalMax);
 }
 
-static void zclApp_bh1750ReadLumosity(void) {
-    IO_PUP_BH1750();
-    zclApp_bh1750IlluminanceSensor_MeasuredValue = (uint16)(bh1850_Read());
-    bh1850_PowerDown();
-    IO_PDN_BH1750();
-        
-    uint16 illum = 0;
-    if (temp_bh1750IlluminanceSensor_MeasuredValue > zclApp_bh1750IlluminanceSensor_MeasuredValue){
-      illum = (temp_bh1750IlluminanceSensor_MeasuredValue - zclApp_bh1750IlluminanceSensor_MeasuredValue);
+static void zclApp_MeasureWithin(uint16 seconds) {
+    uint32 timeout = (uint32)seconds * 1000;
+    // only brings the next measurement closer
+    if (zclWake_Remaining(APP_WAKE_MEASURE) > timeout) {
+        zclWake_Schedule(APP_WAKE_MEASURE, timeout);
+    }
+}
+
+static void zclApp_MeasureActivity(void) {
+    zclSampling_Activity(zclApp_Config.MeasureIntervalMin);
+    zclApp_MeasureWithin(zclApp_Config.MeasureIntervalMin);
+}
+
+static bool zclApp_LdrNeeded(void) {
+    // the BH1750 covers the light level, the LDR is only read to calibrate it
+    return LumDetect == 1 && (bh1750Detect != 1 || zclApp_Config.LdrAutoCalib);
+}
+
+static bool zclApp_ProbeLdr(void) {
+    IO_IMODE_PORT_PIN(LUMOISITY_PORT, LUMOISITY_PIN, IO_TRI); // tri state p0.7 (lumosity pin)
+    ldr_measureSettleUs();
+    zclApp_IlluminanceSensor_MeasuredValueRawAdc = ldr_read();
+    if (zclApp_IlluminanceSensor_MeasuredValueRawAdc > 1000){
+      LumDetect = 1;
     } else {
-      illum = (zclApp_bh1750IlluminanceSensor_MeasuredValue - temp_bh1750IlluminanceSensor_MeasuredValue);
+      IO_IMODE_PORT_PIN(LUMOISITY_PORT, LUMOISITY_PIN, IO_PUD); // Pullup/pulldn input p0.7 (lumosity pin)
+      LumDetect = 0;      
+    }
+    return LumDetect;
+}
+
+static void zclApp_ReadLumosity(void) {
+    if (!zclApp_LdrNeeded()) {
+        return;
+    }
+    zclApp_IlluminanceSensor_MeasuredValueRawAdc = ldr_read();
+    zclApp_IlluminanceSensor_MeasuredValue = ldr_toZclIlluminance(zclApp_IlluminanceSensor_MeasuredValueRawAdc,
+                                                                  zclApp_Config.LdrCalibOffset, zclApp_Config.LdrCalibGain);
+    zclSampling_Track(APP_SIGNAL_LDR, zclApp_IlluminanceSensor_MeasuredValue, 414); // 10 %
+    LREP("IlluminanceSensor_MeasuredValue value=%d\r\n", zclApp_IlluminanceSensor_MeasuredValue);
+}
+
+static void zclApp_CalibrateLdr(void) {
+    uint16 drift;
+    
+    // the LDR was read in the same cycle, right before the BH1750, see zclApp_Sensors
+    zclApp_Config.LdrCalibOffset = ldr_calibrate(zclApp_IlluminanceSensor_MeasuredValue,
+                                                 zclApp_bh1750IlluminanceSensor_MeasuredValue, zclApp_Config.LdrCalibOffset);
+    drift = (zclApp_Config.LdrCalibOffset > savedLdrCalibOffset) ? (zclApp_Config.LdrCalibOffset - savedLdrCalibOffset)
+                                                                 : (savedLdrCalibOffset - zclApp_Config.LdrCalibOffset);
+    if (drift > APP_LDR_CALIB_SAVE_DELTA) {
+      osal_start_timerEx(zclApp_TaskID, APP_SAVE_ATTRS_EVT, 2000);
     }
-    if (illum > 10 || report == 1){
-      temp_bh1750IlluminanceSensor_MeasuredValue = zclApp_bh1750IlluminanceSensor_MeasuredValue;
-      bdb_RepChangedAttrValue(zclApp_FourthEP.EndPoint, ILLUMINANCE, ATTRID_MS_ILLUMINANCE_MEASURED_VALUE);
+}
+
+static bool zclApp_ProbeBH1750(void) {
+    bh1750Detect = bh1750_finishProbe();
+    LREP("bh1750Detect=%d\r\n", bh1750Detect);
+    return bh1750Detect;
+}
+
+static void zclApp_bh1750ReadLumosity(void) {
+    uint32 luxQ8 = bh1850_Read();
+    bh1750_autoRange((luxQ8 >> 8) > 0xFFFF ? 0xFFFF : (uint16)(luxQ8 >> 8));
+    zclApp_bh1750IlluminanceSensor_MeasuredValue = luxToZclIlluminance(luxQ8);
+    zclSampling_Track(APP_SIGNAL_BH1750, zclApp_bh1750IlluminanceSensor_MeasuredValue, 414); // 10 %
+    if (LumDetect == 1 && zclApp_Config.LdrAutoCalib) {
+      zclApp_CalibrateLdr();
+    } else if (LumDetect == 1 && !zclApp_LdrNeeded()) {
+      // endpoint 1 follows the BH1750 while the LDR stays unpowered
+      zclApp_IlluminanceSensor_MeasuredValue = zclApp_bh1750IlluminanceSensor_MeasuredValue;
     }
     LREP("bh1750IlluminanceSensor_MeasuredValue value=%d\r\n", zclApp_bh1750IlluminanceSensor_MeasuredValue);
 }
 
-void user_delay_ms(uint32 period) {MicroWait(period * 1000); }
+void user_delay_ms(uint32 period) { HalDelayMs((uint16)period); }
+
+// ScaledValue = 10^Scale * pressure in Pa
+static int16 zclApp_ScalePressure(uint32 pascals, int8 scale) {
+    int32 scaled = (int32)pascals;
+    for (; scale < 0; scale++) {
+        scaled /= 10;
+    }
+    for (; scale > 0; scale--) {
+        scaled *= 10;
+    }
+    return (int16)scaled;
+}
+
+static bool zclApp_ProbeBME280(void) {
+    bmeDetect = BME280Init();
+    if (bmeDetect == 1) {
+      zclApp_ApplyBME280Profile();
+    }
+    return bmeDetect;
+}
 
 static void zclApp_ReadBME280(void) {
-  
-    bme280_takeForcedMeasurement();
-    uint8 chip = bme280_read8(BME280_REGISTER_CHIPID);
-    LREP("BME280_REGISTER_CHIPID=%d\r\n", chip);;
-    if (chip == 0x60) {
-        zclApp_Temperature_Sensor_MeasuredValue = (int16)(bme280_readTemperature() *100);
+    bme280_raw_t raw;
+    bme280_data_t data;
+
+    if (bme280_readAll(&raw)) {
+        bme280_compensate(&raw, &data);
+
+        zclApp_Temperature_Sensor_MeasuredValue = data.temperature;
         LREP("Temperature=%d\r\n", zclApp_Temperature_Sensor_MeasuredValue);
         
-        zclApp_PressureSensor_ScaledValue = (int16) (pow(10.0, (double) zclApp_PressureSensor_Scale) * (double) bme280_readPressure()* 100);
+        zclApp_PressureSensor_ScaledValue = zclApp_ScalePressure(data.pressure, zclApp_PressureSensor_Scale);
 
-        zclApp_PressureSensor_MeasuredValue = (uint16)bme280_readPressure();
+        zclApp_PressureSensor_MeasuredValue = (int16)(data.pressure / 100);
         LREP("Pressure=%d\r\n", zclApp_PressureSensor_MeasuredValue);
         
-        zclApp_HumiditySensor_MeasuredValue = (uint16)(bme280_readHumidity() * 100);
+        zclApp_HumiditySensor_MeasuredValue = data.humidity;
         LREP("Humidity=%d\r\n", zclApp_HumiditySensor_MeasuredValue);
-        
-        uint16 temp = 0;
-        if (temp_Temperature_Sensor_MeasuredValue > zclApp_Temperature_Sensor_MeasuredValue){
-          temp = (temp_Temperature_Sensor_MeasuredValue - zclApp_Temperature_Sensor_MeasuredValue);
-        } else {
-          temp = (zclApp_Temperature_Sensor_MeasuredValue - temp_Temperature_Sensor_MeasuredValue);
-        }
-        if (temp > 50 || report == 1){ //50 - 0.5 
-          temp_Temperature_Sensor_MeasuredValue = zclApp_Temperature_Sensor_MeasuredValue;
-          bdb_RepChangedAttrValue(zclApp_FirstEP.EndPoint, TEMP, ATTRID_MS_TEMPERATURE_MEASURED_VALUE);
-        }
-        
-        uint16 press = 0;
-        if (temp_PressureSensor_MeasuredValue > zclApp_PressureSensor_MeasuredValue){
-          press = (temp_PressureSensor_MeasuredValue - zclApp_PressureSensor_MeasuredValue);
-        } else {
-          press = (zclApp_PressureSensor_MeasuredValue - temp_PressureSensor_MeasuredValue);
-        }
-        if (press > 1 || report == 1){ //1gPa
-          temp_PressureSensor_MeasuredValue = zclApp_PressureSensor_MeasuredValue; 
-          bdb_RepChangedAttrValue(zclApp_FirstEP.EndPoint, PRESSURE, ATTRID_MS_PRESSURE_MEASUREMENT_MEASURED_VALUE);
-        }
-        
-        uint16 humid = 0;
-        if (temp_HumiditySensor_MeasuredValue > zclApp_HumiditySensor_MeasuredValue){
-          humid = (temp_HumiditySensor_MeasuredValue - zclApp_HumiditySensor_MeasuredValue);
-        } else {
-          humid = (zclApp_HumiditySensor_MeasuredValue - temp_HumiditySensor_MeasuredValue);
-        }
-        if (humid > 1000 || report == 1){ //10%
-          temp_HumiditySensor_MeasuredValue = zclApp_HumiditySensor_MeasuredValue;
-          bdb_RepChangedAttrValue(zclApp_FirstEP.EndPoint, HUMIDITY, ATTRID_MS_RELATIVE_HUMIDITY_MEASURED_VALUE);
-        }
+
+        // same steps as the default reportable changes
+        zclSampling_Track(APP_SIGNAL_TEMPERATURE, zclApp_Temperature_Sensor_MeasuredValue, 50);
+        zclSampling_Track(APP_SIGNAL_PRESSURE, zclApp_PressureSensor_MeasuredValue, 1);
+        zclSampling_Track(APP_SIGNAL_HUMIDITY, zclApp_HumiditySensor_MeasuredValue, 1000);
     } else {
         LREPMaster("NOT BME280\r\n");
     }
 }
 
-static void zclApp_Report(void) { osal_start_reload_timer(zclApp_TaskID, APP_READ_SENSORS_EVT, 100); }
+static void zclApp_ApplyBME280Profile(void) {
+    if (!bme280_setProfile(zclApp_Config.Bme280Profile)) {
+        LREP("Unknown BME280 profile %d\r\n", zclApp_Config.Bme280Profile);
+        zclApp_Config.Bme280Profile = BME280_PROFILE_DEFAULT;
+        bme280_setProfile(zclApp_Config.Bme280Profile);
+    }
+    zclApp_Bme280ConversionTime = bme280_measurementTimeMs();
+    zclApp_Bme280SampleCharge = bme280_sampleChargeNc();
+    LREP("BME280 profile=%d time=%dms charge=%dnC\r\n", zclApp_Config.Bme280Profile,
+         zclApp_Bme280ConversionTime, zclApp_Bme280SampleCharge);
+}
 
 static void zclApp_BasicResetCB(void) {
     LREPMaster("BasicResetCB\r\n");
     zclApp_ResetAttributesToDefaultValues();
-    zclApp_SaveAttributesToNV();
+    // applied and saved the same way as written attributes
+    osal_set_event(zclApp_TaskID, APP_SAVE_ATTRS_EVT);
 }
 
 static ZStatus_t zclApp_ReadWriteAuthCB(afAddrType_t *srcAddr, zclAttrRec_t *pAttr, uint8 oper) {
     LREPMaster("AUTH CB called\r\n");
+    if (oper == ZCL_OPER_WRITE && pAttr->clusterID == METERING) {
+        zclApp_MeterWritten = TRUE;
+    }
 
     osal_start_timerEx(zclApp_TaskID, APP_SAVE_ATTRS_EVT, 2000);
     return ZSuccess;
@@ -547,11 +683,17 @@ static ZStatus_t zclApp_ReadWriteAuthCB(afAddrType_t *srcAddr, zclAttrRec_t *pAt
 static void zclApp_SaveAttributesToNV(void) {
     uint8 writeStatus = osal_nv_write(NW_APP_CONFIG, 0, sizeof(application_config_t), &zclApp_Config);
     LREP("Saving attributes to NV write=%d\r\n", writeStatus);
+    savedLdrCalibOffset = zclApp_Config.LdrCalibOffset;
 }
 
 static void zclApp_RestoreAttributesFromNV(void) {
     uint8 status = osal_nv_item_init(NW_APP_CONFIG, sizeof(application_config_t), NULL);
     LREP("Restoring attributes from NV  status=%d \r\n", status);
+    if (status == ZSUCCESS && osal_nv_item_len(NW_APP_CONFIG) != sizeof(application_config_t)) {
+        // layout changed by firmware update, start over with defaults
+        osal_nv_delete(NW_APP_CONFIG, osal_nv_item_len(NW_APP_CONFIG));
+        status = osal_nv_item_init(NW_APP_CONFIG, sizeof(application_config_t), NULL);
+    }
     if (status == NV_ITEM_UNINIT) {
         uint8 writeStatus = osal_nv_write(NW_APP_CONFIG, 0, sizeof(application_config_t), &zclApp_Config);
         LREP("NV was empty, writing %d\r\n", writeStatus);
@@ -560,6 +702,7 @@ static void zclApp_RestoreAttributesFromNV(void) {
         LREPMaster("Reading from NV\r\n");
         osal_nv_read(NW_APP_CONFIG, 0, sizeof(application_config_t), &zclApp_Config);
     }
+    savedLdrCalibOffset = zclApp_Config.LdrCalibOffset;
 }
 
 /****************************************************************************
@@ -10,6 +10,8 @@ extern "C" {
  */
 #include "version.h"
 #include "zcl.h"
+#include "metering.h"
+#include "reporting.h"
 
 
 /*********************************************************************
@@ -18,14 +20,21 @@ extern "C" {
 
 // Application Events
 #define APP_REPORT_EVT                  0x0001
-#define APP_READ_SENSORS_EVT            0x0002
+#define APP_READ_SENSORS_EVT            0x0002 // conversions of the measurement cycle are done
 #define APP_REPORT_MEASURE_EVT          0x0004
-#define APP_MOTION_ON_EVT               0x0008
-#define APP_MOTION_OFF_EVT              0x0020
-#define APP_MOTION_DELAY_EVT            0x0040
+#define APP_MOTION_EDGE_EVT             0x0008 // PIR edge straight from the port 1 ISR
+#define APP_WAKE_EVT                    0x0010 // timer of the wake scheduler
+#define APP_OCCUPANCY_EVT               0x0020 // timer of the occupancy state machine
+#define APP_METERING_EVT                0x0040 // pulse batch, also the first pulse after standing still
 #define APP_SAVE_ATTRS_EVT              0x0080
-#define APP_CONTACT_DELAY_EVT           0x0100
-#define APP_BH1750_DELAY_EVT            0x0200
+#define APP_CONTACT_EVT                 0x0100 // contact edge from the port 0 ISR
+#define APP_POLL_EVT                    0x0200
+
+// wake scheduler items, see zclApp_WakeItems
+#define APP_WAKE_MEASURE    0
+#define APP_WAKE_REPORT     1
+#define APP_WAKE_POLL       2
+#define APP_WAKE_METERING   3
 
 
 #define AIR_COMPENSATION_FORMULA(ADC)   ((0.179 * (double)ADC + 3926.0))
@@ -33,14 +42,46 @@ extern "C" {
 
 
 
+#define APP_LDR_CALIB_SAVE_DELTA 414 // auto calibration drift before the offset goes to NV, 10 % in ZCL illuminance log units
+
+#define APP_MEASURE_INTERVAL_MIN_DEFAULT 10  // s, floor while readings move
+#define APP_MEASURE_INTERVAL_MAX_DEFAULT 300 // s, ceiling while readings are stable
+#define APP_MEASURE_INTERVAL_LIMIT 3600      // s, longest ceiling accepted
+
+// P0_0 contact input
+#define APP_CONTACT_PIN BV(0)
+#define APP_CONTACT_MODE_CONTACT 0 // On/Off of endpoint 2
+#define APP_CONTACT_MODE_PULSES  1 // pulses of a meter, Metering of endpoint 2
+#define APP_CONTACT_GLITCH_MS 50   // reed and magnet bounce of a door
+#define APP_PULSE_HOLDOFF_MS 20    // contact bounce, up to 50 pulses per second
+
+// P1_3 PIR output, push-pull, no glitch filter
+#define APP_PIR_PIN BV(3)
+
+// On/Off commands of endpoint 3 to the bound lights
+#define APP_LIGHT_CONTROL_DISABLED      0
+#define APP_LIGHT_CONTROL_ON_OFF        1 // On when occupied, Off when unoccupied
+#define APP_LIGHT_CONTROL_ON_TIMED_OFF  2 // On with Timed Off, the light follows the hold by itself
+
+// signals of the adaptive measurement interval
+#define APP_SIGNAL_LDR          0
+#define APP_SIGNAL_BH1750       1
+#define APP_SIGNAL_TEMPERATURE  2
+#define APP_SIGNAL_PRESSURE     3
+#define APP_SIGNAL_HUMIDITY     4
+
 #define APP_REPORT_DELAY ((uint32) 1800000) //30 minutes
+#define APP_BATTERY_PERIOD ((uint16)(APP_REPORT_DELAY / 1000)) // s
+#define APP_REPORT_SLACK ((uint32) 60000)   // a measurement up to a minute before takes the report along
+#define APP_MEASURE_SLACK ((uint32) 2000)
+#define APP_POLL_PERIOD ((uint32) 300000)   // 5 minutes, parent keeps data for us in the meantime
+#define APP_POLL_SLACK ((uint32) 240000)    // rides along with any wakeup in the last 4 minutes
+#define APP_METERING_SLACK ((uint32) 10000)
 //#define APP_REPORT_DELAY ((uint32) 60000) // 60 sec
 
 /*********************************************************************
  * MACROS
  */
-#define NW_APP_CONFIG 0x0401
-
 #define R           ACCESS_CONTROL_READ
 #define RR          (R | ACCESS_REPORTABLE)
 #define RW          (ACCESS_CONTROL_READ | ACCESS_CONTROL_WRITE | ACCESS_CONTROL_AUTH_WRITE)
@@ -53,21 +94,49 @@ extern "C" {
 #define SOIL_HUMIDITY                  0x0408
 #define PRESSURE    ZCL_CLUSTER_ID_MS_PRESSURE_MEASUREMENT
 #define ILLUMINANCE ZCL_CLUSTER_ID_MS_ILLUMINANCE_MEASUREMENT
+#define METERING    ZCL_METERING_CLUSTER_ID
 #define OCCUPANCY   ZCL_CLUSTER_ID_MS_OCCUPANCY_SENSING
 
 #define ZCL_BOOLEAN   ZCL_DATATYPE_BOOLEAN
 #define ZCL_UINT8   ZCL_DATATYPE_UINT8
 #define ZCL_UINT16  ZCL_DATATYPE_UINT16
+#define ZCL_UINT24  ZCL_DATATYPE_UINT24
 #define ZCL_UINT32  ZCL_DATATYPE_UINT32
+#define ZCL_UINT48  ZCL_DATATYPE_UINT48
+#define ZCL_INT24   ZCL_DATATYPE_INT24
 #define ZCL_INT16   ZCL_DATATYPE_INT16
 #define ZCL_INT8    ZCL_DATATYPE_INT8
 #define ZCL_BITMAP8 ZCL_DATATYPE_BITMAP8
 #define ZCL_ENUM8   ZCL_DATATYPE_ENUM8
 
 
+#define ATTRID_BASIC_MEASURE_INTERVAL_MIN                               0x0201 // s
+#define ATTRID_BASIC_MEASURE_INTERVAL_MAX                               0x0202 // s
+#define ATTRID_BASIC_MEASURE_INTERVAL                                   0x0203 // s, current
+#define ATTRID_BASIC_WAKEUPS_PER_HOUR                                   0x0204 // scheduled wakeups in the last full hour
+
+#define ATTRID_MS_OCCUPANCY_SENSING_PIR_U_TO_O_THRESHOLD                0x0012 // ZCL PIRUnoccupiedToOccupiedThreshold
+#define ATTRID_MS_OCCUPANCY_SENSING_MOTION_LATENCY                      0x0200 // us, PIR edge to the report handed to AF
+#define ATTRID_MS_OCCUPANCY_SENSING_MOTION_LATENCY_MAX                  0x0201 // us, since boot
+#define ATTRID_MS_OCCUPANCY_SENSING_LIGHT_CONTROL                       0x0202 // APP_LIGHT_CONTROL_*
+#define ATTRID_MS_OCCUPANCY_SENSING_LIGHT_ILLUMINANCE_MAX               0x0203 // ZCL illuminance units, 0 - no gate
+
+#define ATTRID_ON_OFF_CONTACT_MODE                                      0x0200 // APP_CONTACT_MODE_*
+#define ATTRID_ON_OFF_CONTACT_BOUNCES                                   0x0201 // of the previous contact change
+
 #define ATTRID_MS_RELATIVE_HUMIDITY_MEASURED_VALUE_RAW_ADC              0x0200
 #define ATTRID_MS_RELATIVE_HUMIDITY_MEASURED_VALUE_BATTERY_RAW_ADC      0x0201
 
+#define ATTRID_MS_ILLUMINANCE_MEASURED_VALUE_RAW_ADC                    0x0200
+#define ATTRID_MS_ILLUMINANCE_LDR_CALIB_OFFSET                          0x0201 // ZCL illuminance units
+#define ATTRID_MS_ILLUMINANCE_LDR_CALIB_GAIN                            0x0202 // Q12
+#define ATTRID_MS_ILLUMINANCE_LDR_AUTO_CALIB                            0x0203 // follow BH1750 on endpoint 4
+#define ATTRID_MS_ILLUMINANCE_LDR_EXCITATION_CHARGE                     0x0204 // nC since boot
+
+#define ATTRID_MS_PRESSURE_MEASUREMENT_BME280_PROFILE                   0x0200
+#define ATTRID_MS_PRESSURE_MEASUREMENT_BME280_CONVERSION_TIME           0x0201 // ms
+#define ATTRID_MS_PRESSURE_MEASUREMENT_BME280_SAMPLE_CHARGE             0x0202 // nC
+
 
 
 /*********************************************************************
@@ -90,6 +159,8 @@ extern int16 zclApp_Temperature_Sensor_MeasuredValue;
 extern int16 zclApp_PressureSensor_MeasuredValue;
 extern int16 zclApp_PressureSensor_ScaledValue;
 extern int8 zclApp_PressureSensor_Scale;
+extern uint16 zclApp_Bme280ConversionTime;
+extern uint16 zclApp_Bme280SampleCharge;
 extern uint16 zclApp_HumiditySensor_MeasuredValue;
 extern int16 zclApp_DS18B20_MeasuredValue;
 extern uint16 zclApp_SoilHumiditySensor_MeasuredValue;
@@ -99,15 +170,32 @@ extern uint16 zclApp_IlluminanceSensor_MeasuredValueRawAdc;
 extern uint16 zclApp_bh1750IlluminanceSensor_MeasuredValue;
 
 extern uint8 zclApp_Magnet_OnOff;
+extern uint16 zclApp_ContactBounces;
 // Occupancy Cluster 
 extern uint8 zclApp_Occupied; 
 extern uint8 zclApp_OccType; 
+extern uint16 zclApp_MotionLatency;
+extern uint16 zclApp_MotionLatencyMax;
 //extern uint16 zclApp_PirOccupiedToUnoccupiedDelay; 
 //extern uint16 zclApp_PirUnoccupiedToOccupiedDelay;
 typedef struct
 {
     uint16 PirOccupiedToUnoccupiedDelay;
     uint16 PirUnoccupiedToOccupiedDelay;
+    uint8 PirUnoccupiedToOccupiedThreshold;
+    uint8 LightControl;
+    uint16 LightIlluminanceMax;
+    uint8 ContactMode;
+    uint8 MeterUnit;
+    uint32 MeterMultiplier;
+    uint32 MeterDivisor;
+    uint8 MeterDeviceType;
+    uint8 Bme280Profile;
+    int16 LdrCalibOffset;
+    uint16 LdrCalibGain;
+    uint8 LdrAutoCalib;
+    uint16 MeasureIntervalMin;
+    uint16 MeasureIntervalMax;
 }  application_config_t;
 
 extern application_config_t zclApp_Config;
@@ -123,6 +211,9 @@ extern CONST uint8 zclApp_AttrsFirstEPCount;
 extern CONST uint8 zclApp_AttrsThirdEPCount;
 extern CONST uint8 zclApp_AttrsFourthEPCount;
 
+extern CONST zclReportingEntry_t zclApp_ReportingEntries[];
+extern CONST uint8 zclApp_ReportingEntriesCount;
+
 extern const uint8 zclApp_ManufacturerName[];
 extern const uint8 zclApp_ModelId[];
 extern const uint8 zclApp_PowerSource;
@@ -11,7 +11,11 @@
 #include "zcl_app.h"
 
 #include "battery.h"
+#include "bme280spi.h"
+#include "ldr.h"
+#include "sampling.h"
 #include "version.h"
+#include "wake.h"
 /*********************************************************************
  * CONSTANTS
  */
@@ -41,6 +45,8 @@ int16 zclApp_Temperature_Sensor_MeasuredValue = 0;
 int16 zclApp_PressureSensor_MeasuredValue = 0;
 int16 zclApp_PressureSensor_ScaledValue = 0;
 int8 zclApp_PressureSensor_Scale = -1;
+uint16 zclApp_Bme280ConversionTime = 0;
+uint16 zclApp_Bme280SampleCharge = 0;
 
 uint16 zclApp_HumiditySensor_MeasuredValue = 0;
 
@@ -54,15 +60,33 @@ uint16 zclApp_IlluminanceSensor_MeasuredValueRawAdc = 0;
 uint16 zclApp_bh1750IlluminanceSensor_MeasuredValue = 0;
 
 uint8 zclApp_Magnet_OnOff = 0;
+uint16 zclApp_ContactBounces = 0;
 
 // Occupancy Cluster 
 uint8 zclApp_Occupied = 0; 
 /* Set default to Not be occupied */ 
 uint8 zclApp_OccType = MS_OCCUPANCY_SENSOR_TYPE_PIR; 
+uint16 zclApp_MotionLatency = 0;
+uint16 zclApp_MotionLatencyMax = 0;
 #define DEFAULT_PirOccupiedToUnoccupiedDelay 20
 #define DEFAULT_PirUnoccupiedToOccupiedDelay 5
+#define DEFAULT_PirUnoccupiedToOccupiedThreshold 1
 application_config_t zclApp_Config = {.PirOccupiedToUnoccupiedDelay = DEFAULT_PirOccupiedToUnoccupiedDelay,
-                                      .PirUnoccupiedToOccupiedDelay = DEFAULT_PirUnoccupiedToOccupiedDelay};
+                                      .PirUnoccupiedToOccupiedDelay = DEFAULT_PirUnoccupiedToOccupiedDelay,
+                                      .PirUnoccupiedToOccupiedThreshold = DEFAULT_PirUnoccupiedToOccupiedThreshold,
+                                      .LightControl = APP_LIGHT_CONTROL_DISABLED,
+                                      .LightIlluminanceMax = 0,
+                                      .ContactMode = APP_CONTACT_MODE_CONTACT,
+                                      .MeterUnit = ZCL_METERING_UNIT_M3,
+                                      .MeterMultiplier = 1,
+                                      .MeterDivisor = 100, // 10 l per pulse
+                                      .MeterDeviceType = ZCL_METERING_DEVICE_WATER,
+                                      .Bme280Profile = BME280_PROFILE_DEFAULT,
+                                      .LdrCalibOffset = LDR_CALIB_OFFSET_DEFAULT,
+                                      .LdrCalibGain = LDR_CALIB_GAIN_DEFAULT,
+                                      .LdrAutoCalib = FALSE,
+                                      .MeasureIntervalMin = APP_MEASURE_INTERVAL_MIN_DEFAULT,
+                                      .MeasureIntervalMax = APP_MEASURE_INTERVAL_MAX_DEFAULT};
 
 // Basic Cluster
 const uint8 zclApp_HWRevision = APP_HWVERSION;
@@ -104,6 +128,10 @@ CONST zclAttrRec_t zclApp_AttrsFirstEP[] = {
     {BASIC, {ATTRID_BASIC_POWER_SOURCE, ZCL_DATATYPE_ENUM8, R, (void *)&zclApp_PowerSource}},
     {BASIC, {ATTRID_BASIC_SW_BUILD_ID, ZCL_DATATYPE_CHAR_STR, R, (void *)zclApp_DateCode}},
     {BASIC, {ATTRID_CLUSTER_REVISION, ZCL_DATATYPE_UINT16, R, (void *)&zclApp_clusterRevision_all}},   
+    {BASIC, {ATTRID_BASIC_MEASURE_INTERVAL_MIN, ZCL_UINT16, RW, (void *)&zclApp_Config.MeasureIntervalMin}},
+    {BASIC, {ATTRID_BASIC_MEASURE_INTERVAL_MAX, ZCL_UINT16, RW, (void *)&zclApp_Config.MeasureIntervalMax}},
+    {BASIC, {ATTRID_BASIC_MEASURE_INTERVAL, ZCL_UINT16, R, (void *)&zclSampling_Interval}},
+    {BASIC, {ATTRID_BASIC_WAKEUPS_PER_HOUR, ZCL_UINT16, R, (void *)&zclWake_PerHour}},
     
     {POWER_CFG, {ATTRID_POWER_CFG_BATTERY_VOLTAGE, ZCL_UINT8, RR, (void *)&zclBattery_Voltage}},
 /**
@@ -113,32 +141,73 @@ CONST zclAttrRec_t zclApp_AttrsFirstEP[] = {
     {POWER_CFG, {ATTRID_POWER_CFG_BATTERY_VOLTAGE_RAW_ADC, ZCL_UINT16, RR, (void *)&zclBattery_RawAdc}},
 
     {ILLUMINANCE, {ATTRID_MS_ILLUMINANCE_MEASURED_VALUE, ZCL_UINT16, RR, (void *)&zclApp_IlluminanceSensor_MeasuredValue}},
+    {ILLUMINANCE, {ATTRID_MS_ILLUMINANCE_MEASURED_VALUE_RAW_ADC, ZCL_UINT16, R, (void *)&zclApp_IlluminanceSensor_MeasuredValueRawAdc}},
+    {ILLUMINANCE, {ATTRID_MS_ILLUMINANCE_LDR_CALIB_OFFSET, ZCL_INT16, RW, (void *)&zclApp_Config.LdrCalibOffset}},
+    {ILLUMINANCE, {ATTRID_MS_ILLUMINANCE_LDR_CALIB_GAIN, ZCL_UINT16, RW, (void *)&zclApp_Config.LdrCalibGain}},
+    {ILLUMINANCE, {ATTRID_MS_ILLUMINANCE_LDR_AUTO_CALIB, ZCL_BOOLEAN, RW, (void *)&zclApp_Config.LdrAutoCalib}},
+    {ILLUMINANCE, {ATTRID_MS_ILLUMINANCE_LDR_EXCITATION_CHARGE, ZCL_UINT32, R, (void *)&ldr_excitationChargeNc}},
     
     {TEMP, {ATTRID_MS_TEMPERATURE_MEASURED_VALUE, ZCL_INT16, RR, (void *)&zclApp_Temperature_Sensor_MeasuredValue}},
 
     {PRESSURE, {ATTRID_MS_PRESSURE_MEASUREMENT_MEASURED_VALUE, ZCL_INT16, RR, (void *)&zclApp_PressureSensor_MeasuredValue}},
     {PRESSURE, {ATTRID_MS_PRESSURE_MEASUREMENT_SCALED_VALUE, ZCL_INT16, RR, (void *)&zclApp_PressureSensor_ScaledValue}},
     {PRESSURE, {ATTRID_MS_PRESSURE_MEASUREMENT_SCALE, ZCL_INT8, RR, (void *)&zclApp_PressureSensor_Scale}},
+    {PRESSURE, {ATTRID_MS_PRESSURE_MEASUREMENT_BME280_PROFILE, ZCL_ENUM8, RW, (void *)&zclApp_Config.Bme280Profile}},
+    {PRESSURE, {ATTRID_MS_PRESSURE_MEASUREMENT_BME280_CONVERSION_TIME, ZCL_UINT16, R, (void *)&zclApp_Bme280ConversionTime}},
+    {PRESSURE, {ATTRID_MS_PRESSURE_MEASUREMENT_BME280_SAMPLE_CHARGE, ZCL_UINT16, R, (void *)&zclApp_Bme280SampleCharge}},
 
     {HUMIDITY, {ATTRID_MS_RELATIVE_HUMIDITY_MEASURED_VALUE, ZCL_UINT16, RR, (void *)&zclApp_HumiditySensor_MeasuredValue}}
 };
 
 
 CONST zclAttrRec_t zclApp_AttrsSecondEP[] = {
-    {ONOFF, {ATTRID_ON_OFF, ZCL_BOOLEAN, RR, (void *)&zclApp_Magnet_OnOff}}
+    {ONOFF, {ATTRID_ON_OFF, ZCL_BOOLEAN, RR, (void *)&zclApp_Magnet_OnOff}},
+    {ONOFF, {ATTRID_ON_OFF_CONTACT_MODE, ZCL_ENUM8, RW, (void *)&zclApp_Config.ContactMode}},
+    {ONOFF, {ATTRID_ON_OFF_CONTACT_BOUNCES, ZCL_UINT16, R, (void *)&zclApp_ContactBounces}},
+
+    {METERING, {ZCL_METERING_ATTRID_CURRENT_SUMMATION_DELIVERED, ZCL_UINT48, RW, (void *)zclMetering_Summation}},
+    {METERING, {ZCL_METERING_ATTRID_STATUS, ZCL_BITMAP8, R, (void *)&zclMetering_Status}},
+    {METERING, {ZCL_METERING_ATTRID_UNIT_OF_MEASURE, ZCL_ENUM8, RW, (void *)&zclApp_Config.MeterUnit}},
+    {METERING, {ZCL_METERING_ATTRID_MULTIPLIER, ZCL_UINT24, RW, (void *)&zclApp_Config.MeterMultiplier}},
+    {METERING, {ZCL_METERING_ATTRID_DIVISOR, ZCL_UINT24, RW, (void *)&zclApp_Config.MeterDivisor}},
+    {METERING, {ZCL_METERING_ATTRID_DEVICE_TYPE, ZCL_BITMAP8, RW, (void *)&zclApp_Config.MeterDeviceType}},
+    {METERING, {ZCL_METERING_ATTRID_INSTANTANEOUS_DEMAND, ZCL_INT24, R, (void *)&zclMetering_Demand}}
 };
 
 CONST zclAttrRec_t zclApp_AttrsThirdEP[] = {
     {OCCUPANCY, {ATTRID_MS_OCCUPANCY_SENSING_CONFIG_OCCUPANCY, ZCL_BITMAP8, RR, (void *)&zclApp_Occupied}},
     {OCCUPANCY, {ATTRID_MS_OCCUPANCY_SENSING_CONFIG_OCCUPANCY_SENSOR_TYPE, ZCL_ENUM8, RR, (void *)&zclApp_OccType}},
     {OCCUPANCY, {ATTRID_MS_OCCUPANCY_SENSING_CONFIG_PIR_O_TO_U_DELAY, ZCL_UINT16, RW, (void *)&zclApp_Config.PirOccupiedToUnoccupiedDelay}},
-    {OCCUPANCY, {ATTRID_MS_OCCUPANCY_SENSING_CONFIG_PIR_U_TO_O_DELAY, ZCL_UINT16, RW, (void *)&zclApp_Config.PirUnoccupiedToOccupiedDelay}}
+    {OCCUPANCY, {ATTRID_MS_OCCUPANCY_SENSING_CONFIG_PIR_U_TO_O_DELAY, ZCL_UINT16, RW, (void *)&zclApp_Config.PirUnoccupiedToOccupiedDelay}},
+    {OCCUPANCY, {ATTRID_MS_OCCUPANCY_SENSING_PIR_U_TO_O_THRESHOLD, ZCL_UINT8, RW, (void *)&zclApp_Config.PirUnoccupiedToOccupiedThreshold}},
+    {OCCUPANCY, {ATTRID_MS_OCCUPANCY_SENSING_MOTION_LATENCY, ZCL_UINT16, R, (void *)&zclApp_MotionLatency}},
+    {OCCUPANCY, {ATTRID_MS_OCCUPANCY_SENSING_MOTION_LATENCY_MAX, ZCL_UINT16, R, (void *)&zclApp_MotionLatencyMax}},
+    {OCCUPANCY, {ATTRID_MS_OCCUPANCY_SENSING_LIGHT_CONTROL, ZCL_ENUM8, RW, (void *)&zclApp_Config.LightControl}},
+    {OCCUPANCY, {ATTRID_MS_OCCUPANCY_SENSING_LIGHT_ILLUMINANCE_MAX, ZCL_UINT16, RW, (void *)&zclApp_Config.LightIlluminanceMax}}
 };
 
 CONST zclAttrRec_t zclApp_AttrsFourthEP[] = {
     {ILLUMINANCE, {ATTRID_MS_ILLUMINANCE_MEASURED_VALUE, ZCL_UINT16, RR, (void *)&zclApp_bh1750IlluminanceSensor_MeasuredValue}}
 };
 
+/*
+ * Default reporting configuration, a ZCL Configure Reporting from the
+ * coordinator replaces it per attribute
+ */
+CONST zclReportingEntry_t zclApp_ReportingEntries[] = {
+    {1, POWER_CFG, ATTRID_POWER_CFG_BATTERY_VOLTAGE, ZCL_UINT8, (void *)&zclBattery_Voltage, 60, 3600, 1},                   // 0.1 V
+    {1, POWER_CFG, ATTRID_POWER_CFG_BATTERY_PERCENTAGE_REMAINING, ZCL_UINT8, (void *)&zclBattery_PercentageRemainig, 60, 3600, 2}, // 1 %
+    {1, ILLUMINANCE, ATTRID_MS_ILLUMINANCE_MEASURED_VALUE, ZCL_UINT16, (void *)&zclApp_IlluminanceSensor_MeasuredValue, 10, 3600, 414}, // 10 %
+    {1, TEMP, ATTRID_MS_TEMPERATURE_MEASURED_VALUE, ZCL_INT16, (void *)&zclApp_Temperature_Sensor_MeasuredValue, 10, 3600, 50}, // 0.5 C
+    {1, PRESSURE, ATTRID_MS_PRESSURE_MEASUREMENT_MEASURED_VALUE, ZCL_INT16, (void *)&zclApp_PressureSensor_MeasuredValue, 10, 3600, 1}, // 1 hPa
+    {1, HUMIDITY, ATTRID_MS_RELATIVE_HUMIDITY_MEASURED_VALUE, ZCL_UINT16, (void *)&zclApp_HumiditySensor_MeasuredValue, 10, 3600, 1000}, // 10 %
+    {2, ONOFF, ATTRID_ON_OFF, ZCL_BOOLEAN, (void *)&zclApp_Magnet_OnOff, 0, 3600, 0},
+    {3, OCCUPANCY, ATTRID_MS_OCCUPANCY_SENSING_CONFIG_OCCUPANCY, ZCL_BITMAP8, (void *)&zclApp_Occupied, 0, 3600, 0},
+    {4, ILLUMINANCE, ATTRID_MS_ILLUMINANCE_MEASURED_VALUE, ZCL_UINT16, (void *)&zclApp_bh1750IlluminanceSensor_MeasuredValue, 10, 3600, 414} // 10 %
+};
+
+uint8 CONST zclApp_ReportingEntriesCount = (sizeof(zclApp_ReportingEntries) / sizeof(zclApp_ReportingEntries[0]));
+
 uint8 CONST zclApp_AttrsSecondEPCount = (sizeof(zclApp_AttrsSecondEP) / sizeof(zclApp_AttrsSecondEP[0]));
 uint8 CONST zclApp_AttrsFirstEPCount = (sizeof(zclApp_AttrsFirstEP) / sizeof(zclApp_AttrsFirstEP[0]));
 uint8 CONST zclApp_AttrsThirdEPCount = (sizeof(zclApp_AttrsThirdEP) / sizeof(zclApp_AttrsThirdEP[0]));
@@ -149,8 +218,8 @@ const cId_t zclApp_InClusterList[] = {ZCL_CLUSTER_ID_GEN_BASIC};
 #define APP_MAX_INCLUSTERS (sizeof(zclApp_InClusterList) / sizeof(zclApp_InClusterList[0]))
 
 const cId_t zclApp_OutClusterListFirstEP[] = {POWER_CFG, ILLUMINANCE, TEMP, PRESSURE, HUMIDITY};
-const cId_t zclApp_OutClusterListSecondEP[] = {ONOFF};
-const cId_t zclApp_OutClusterListThirdEP[] = {ZCL_CLUSTER_ID_MS_OCCUPANCY_SENSING};
+const cId_t zclApp_OutClusterListSecondEP[] = {ONOFF, METERING};
+const cId_t zclApp_OutClusterListThirdEP[] = {ZCL_CLUSTER_ID_MS_OCCUPANCY_SENSING, ONOFF}; // On/Off client for the bound lights
 const cId_t zclApp_OutClusterListFourthEP[] = {ILLUMINANCE};
 
 #define APP_MAX_OUTCLUSTERS_FIRST_EP (sizeof(zclApp_OutClusterListFirstEP) / sizeof(zclApp_OutClusterListFirstEP[0]))
@@ -212,4 +281,18 @@ SimpleDescriptionFormat_t zclApp_FourthEP = {
 void zclApp_ResetAttributesToDefaultValues(void) {
     zclApp_Config.PirOccupiedToUnoccupiedDelay = DEFAULT_PirOccupiedToUnoccupiedDelay;
     zclApp_Config.PirUnoccupiedToOccupiedDelay = DEFAULT_PirUnoccupiedToOccupiedDelay;
+    zclApp_Config.PirUnoccupiedToOccupiedThreshold = DEFAULT_PirUnoccupiedToOccupiedThreshold;
+    zclApp_Config.LightControl = APP_LIGHT_CONTROL_DISABLED;
+    zclApp_Config.LightIlluminanceMax = 0;
+    zclApp_Config.ContactMode = APP_CONTACT_MODE_CONTACT;
+    zclApp_Config.MeterUnit = ZCL_METERING_UNIT_M3;
+    zclApp_Config.MeterMultiplier = 1;
+    zclApp_Config.MeterDivisor = 100;
+    zclApp_Config.MeterDeviceType = ZCL_METERING_DEVICE_WATER;
+    zclApp_Config.Bme280Profile = BME280_PROFILE_DEFAULT;
+    zclApp_Config.LdrCalibOffset = LDR_CALIB_OFFSET_DEFAULT;
+    zclApp_Config.LdrCalibGain = LDR_CALIB_GAIN_DEFAULT;
+    zclApp_Config.LdrAutoCalib = FALSE;
+    zclApp_Config.MeasureIntervalMin = APP_MEASURE_INTERVAL_MIN_DEFAULT;
+    zclApp_Config.MeasureIntervalMax = APP_MEASURE_INTERVAL_MAX_DEFAULT;
 }
\ No newline at end of file
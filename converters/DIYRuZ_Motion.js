@@ -35,6 +35,17 @@ const postfixWithEndpointName = (name, msg, definition) => {
     }
 };
 
+const bme280Profiles = ['ultra_low_power', 'weather_station', 'indoor_navigation'];
+const lightControlModes = ['disabled', 'on_off', 'on_timed_off'];
+const contactModes = ['contact', 'pulses'];
+
+// uint48 summation arrives as [high, low] 32 bit words
+const toNumber = (value) => Array.isArray(value) ? value[0] * 0x100000000 + value[1] : value;
+
+// ZCL illuminance is 10000 * log10(lux) + 1, 0 stands for no limit
+const luxToZcl = (lux) => lux > 0 ? Math.round(10000 * Math.log10(lux) + 1) : 0;
+const zclToLux = (value) => value > 0 ? Math.round(Math.pow(10, (value - 1) / 10000)) : 0;
+
 const fz = {
     occupancy_sensor_type: {
         cluster: 'msOccupancySensing',
@@ -52,11 +63,152 @@ const fz = {
             if (msg.data.hasOwnProperty('measuredValue')) {
                 const illuminance = msg.data['measuredValue'];
                 const property = postfixWithEndpointName('illuminance', msg, model);
-                return {[property]: msg.data.measuredValue};
+                // LDR and BH1750 both report 10000 * log10(lux) + 1 as the ZCL spec says
+                const lux = illuminance === 0 ? 0 : Math.pow(10, (illuminance - 1) / 10000);
+                return {[property]: Math.round(lux * 100) / 100};
 //                return {illuminance: msg.data.measuredValue};
             }
         },
     },
+    ldr_calibration: {
+        cluster: 'msIlluminanceMeasurement',
+        type: ['attributeReport', 'readResponse'],
+        convert: (model, msg, publish, options, meta) => {
+            const result = {};
+            if (msg.data.hasOwnProperty(0x0200)) {
+                result.ldr_raw_adc = msg.data[0x0200];
+            }
+            if (msg.data.hasOwnProperty(0x0201)) {
+                result.ldr_calibration_offset = msg.data[0x0201];
+            }
+            if (msg.data.hasOwnProperty(0x0202)) {
+                result.ldr_calibration_gain = msg.data[0x0202] / 4096;
+            }
+            if (msg.data.hasOwnProperty(0x0203)) {
+                result.ldr_auto_calibration = msg.data[0x0203] === 1;
+            }
+            if (msg.data.hasOwnProperty(0x0204)) {
+                result.ldr_excitation_charge = msg.data[0x0204];
+            }
+            return result;
+        },
+    },
+    report_statistics: {
+        cluster: 'genBasic',
+        type: ['attributeReport', 'readResponse'],
+        convert: (model, msg, publish, options, meta) => {
+            const result = {};
+            if (msg.data.hasOwnProperty(0x0201)) {
+                result.measure_interval_min = msg.data[0x0201];
+            }
+            if (msg.data.hasOwnProperty(0x0202)) {
+                result.measure_interval_max = msg.data[0x0202];
+            }
+            if (msg.data.hasOwnProperty(0x0203)) {
+                result.measure_interval = msg.data[0x0203];
+            }
+            if (msg.data.hasOwnProperty(0x0204)) {
+                result.wakeups_per_hour = msg.data[0x0204];
+            }
+            return result;
+        },
+    },
+    occupancy_trigger: {
+        cluster: 'msOccupancySensing',
+        type: ['attributeReport', 'readResponse'],
+        convert: (model, msg, publish, options, meta) => {
+            const result = {};
+            if (msg.data.hasOwnProperty('pirOToUDelay')) {
+                result.occupancy_timeout = msg.data.pirOToUDelay;
+            }
+            if (msg.data.hasOwnProperty('pirUToODelay')) {
+                result.occupancy_trigger_window = msg.data.pirUToODelay;
+            }
+            if (msg.data.hasOwnProperty('pirUToOThreshold')) {
+                result.occupancy_trigger_threshold = msg.data.pirUToOThreshold;
+            }
+            return result;
+        },
+    },
+    occupancy_custom: {
+        cluster: 'msOccupancySensing',
+        type: ['attributeReport', 'readResponse'],
+        convert: (model, msg, publish, options, meta) => {
+            const result = {};
+            if (msg.data.hasOwnProperty(0x0200)) {
+                result.motion_latency = msg.data[0x0200];
+            }
+            if (msg.data.hasOwnProperty(0x0201)) {
+                result.motion_latency_max = msg.data[0x0201];
+            }
+            if (msg.data.hasOwnProperty(0x0202)) {
+                result.light_control = lightControlModes[msg.data[0x0202]];
+            }
+            if (msg.data.hasOwnProperty(0x0203)) {
+                result.light_illuminance_max = zclToLux(msg.data[0x0203]);
+            }
+            return result;
+        },
+    },
+    metering: {
+        // pulses of the meter on the contact input, scaled by multiplier / divisor
+        cluster: 'seMetering',
+        type: ['attributeReport', 'readResponse'],
+        convert: (model, msg, publish, options, meta) => {
+            const result = {};
+            const ep = msg.endpoint;
+            if (msg.data.hasOwnProperty('multiplier')) {
+                ep.saveClusterAttributeKeyValue('seMetering', {multiplier: msg.data.multiplier});
+                result.meter_multiplier = msg.data.multiplier;
+            }
+            if (msg.data.hasOwnProperty('divisor')) {
+                ep.saveClusterAttributeKeyValue('seMetering', {divisor: msg.data.divisor});
+                result.meter_divisor = msg.data.divisor;
+            }
+            const multiplier = ep.getClusterAttributeValue('seMetering', 'multiplier') || 1;
+            const divisor = ep.getClusterAttributeValue('seMetering', 'divisor') || 1;
+            if (msg.data.hasOwnProperty('currentSummDelivered')) {
+                const pulses = toNumber(msg.data.currentSummDelivered);
+                result.meter_pulses = pulses;
+                result.volume = pulses * multiplier / divisor;
+            }
+            if (msg.data.hasOwnProperty('instantaneousDemand')) {
+                result.flow = msg.data.instantaneousDemand * multiplier / divisor;
+            }
+            return result;
+        },
+    },
+    contact_mode: {
+        cluster: 'genOnOff',
+        type: ['attributeReport', 'readResponse'],
+        convert: (model, msg, publish, options, meta) => {
+            const result = {};
+            if (msg.data.hasOwnProperty(0x0200)) {
+                result.contact_mode = contactModes[msg.data[0x0200]];
+            }
+            if (msg.data.hasOwnProperty(0x0201)) {
+                result.contact_bounces = msg.data[0x0201];
+            }
+            return result;
+        },
+    },
+    bme280_profile: {
+        cluster: 'msPressureMeasurement',
+        type: ['attributeReport', 'readResponse'],
+        convert: (model, msg, publish, options, meta) => {
+            const result = {};
+            if (msg.data.hasOwnProperty(0x0200)) {
+                result.bme280_profile = bme280Profiles[msg.data[0x0200]];
+            }
+            if (msg.data.hasOwnProperty(0x0201)) {
+                result.bme280_conversion_time = msg.data[0x0201];
+            }
+            if (msg.data.hasOwnProperty(0x0202)) {
+                result.bme280_sample_charge = msg.data[0x0202];
+            }
+            return result;
+        },
+    },
 };
 const tz = {
     occupancy_timeout: {
@@ -73,6 +225,124 @@ const tz = {
             await thirdEndpoint.read('msOccupancySensing', ['pirOToUDelay']);
         },
     },
+    occupancy_trigger: {
+        // motion edges needed within the window before occupied is reported
+        key: ['occupancy_trigger_window', 'occupancy_trigger_threshold'],
+        convertSet: async (entity, key, value, meta) => {
+            value *= 1;
+            const thirdEndpoint = meta.device.getEndpoint(3);
+            const attr = key === 'occupancy_trigger_window' ? 'pirUToODelay' : 'pirUToOThreshold';
+            await thirdEndpoint.write('msOccupancySensing', {[attr]: value});
+            return {state: {[key]: value}};
+        },
+        convertGet: async (entity, key, meta) => {
+            const thirdEndpoint = meta.device.getEndpoint(3);
+            await thirdEndpoint.read('msOccupancySensing', ['pirUToODelay', 'pirUToOThreshold']);
+        },
+    },
+    light_control: {
+        // On/Off commands of endpoint 3 to the bound lights, gated by the BH1750 illuminance
+        key: ['light_control', 'light_illuminance_max'],
+        convertSet: async (entity, key, value, meta) => {
+            const thirdEndpoint = meta.device.getEndpoint(3);
+            const payloads = {
+                light_control: {0x0202: {value: lightControlModes.indexOf(value), type: 0x30}},
+                light_illuminance_max: {0x0203: {value: luxToZcl(value), type: 0x21}},
+            };
+            await thirdEndpoint.write('msOccupancySensing', payloads[key]);
+            return {state: {[key]: value}};
+        },
+        convertGet: async (entity, key, meta) => {
+            const thirdEndpoint = meta.device.getEndpoint(3);
+            await thirdEndpoint.read('msOccupancySensing', [0x0202, 0x0203]);
+        },
+    },
+    contact_mode: {
+        // contact input as On/Off or as pulse counter of a meter
+        key: ['contact_mode'],
+        convertSet: async (entity, key, value, meta) => {
+            const secondEndpoint = meta.device.getEndpoint(2);
+            await secondEndpoint.write('genOnOff', {0x0200: {value: contactModes.indexOf(value), type: 0x30}});
+            return {state: {contact_mode: value}};
+        },
+        convertGet: async (entity, key, meta) => {
+            const secondEndpoint = meta.device.getEndpoint(2);
+            await secondEndpoint.read('genOnOff', [0x0200]);
+        },
+    },
+    contact_bounces: {
+        key: ['contact_bounces'],
+        convertGet: async (entity, key, meta) => {
+            const secondEndpoint = meta.device.getEndpoint(2);
+            await secondEndpoint.read('genOnOff', [0x0201]);
+        },
+    },
+    metering: {
+        // pulse scaling and the meter reading, volume sets the summation
+        key: ['meter_multiplier', 'meter_divisor', 'volume'],
+        convertSet: async (entity, key, value, meta) => {
+            const secondEndpoint = meta.device.getEndpoint(2);
+            if (key === 'volume') {
+                const multiplier = secondEndpoint.getClusterAttributeValue('seMetering', 'multiplier') || 1;
+                const divisor = secondEndpoint.getClusterAttributeValue('seMetering', 'divisor') || 1;
+                const pulses = Math.round(value * divisor / multiplier);
+                await secondEndpoint.write('seMetering', {currentSummDelivered: [Math.floor(pulses / 0x100000000), pulses % 0x100000000]});
+            } else {
+                const attr = key === 'meter_multiplier' ? 'multiplier' : 'divisor';
+                await secondEndpoint.write('seMetering', {[attr]: Math.round(value)});
+            }
+            return {state: {[key]: value}};
+        },
+        convertGet: async (entity, key, meta) => {
+            const secondEndpoint = meta.device.getEndpoint(2);
+            await secondEndpoint.read('seMetering', ['multiplier', 'divisor', 'currentSummDelivered']);
+        },
+    },
+    bme280_profile: {
+        // oversampling and filter profile of BME280, see bme280Profiles
+        key: ['bme280_profile'],
+        convertSet: async (entity, key, value, meta) => {
+            const firstEndpoint = meta.device.getEndpoint(1);
+            await firstEndpoint.write('msPressureMeasurement', {0x0200: {value: bme280Profiles.indexOf(value), type: 0x30}});
+            return {state: {bme280_profile: value}};
+        },
+        convertGet: async (entity, key, meta) => {
+            const firstEndpoint = meta.device.getEndpoint(1);
+            await firstEndpoint.read('msPressureMeasurement', [0x0200, 0x0201, 0x0202]);
+        },
+    },
+    ldr_calibration: {
+        // offset in ZCL illuminance units, gain as a factor, auto calibration against the BH1750
+        key: ['ldr_calibration_offset', 'ldr_calibration_gain', 'ldr_auto_calibration'],
+        convertSet: async (entity, key, value, meta) => {
+            const firstEndpoint = meta.device.getEndpoint(1);
+            const payloads = {
+                ldr_calibration_offset: {0x0201: {value: Math.round(value), type: 0x29}},
+                ldr_calibration_gain: {0x0202: {value: Math.round(value * 4096), type: 0x21}},
+                ldr_auto_calibration: {0x0203: {value: value ? 1 : 0, type: 0x10}},
+            };
+            await firstEndpoint.write('msIlluminanceMeasurement', payloads[key]);
+            return {state: {[key]: value}};
+        },
+        convertGet: async (entity, key, meta) => {
+            const firstEndpoint = meta.device.getEndpoint(1);
+            await firstEndpoint.read('msIlluminanceMeasurement', [0x0200, 0x0201, 0x0202, 0x0203, 0x0204]);
+        },
+    },
+    measure_interval: {
+        // bounds of the adaptive measurement interval in seconds
+        key: ['measure_interval_min', 'measure_interval_max'],
+        convertSet: async (entity, key, value, meta) => {
+            const firstEndpoint = meta.device.getEndpoint(1);
+            const attrId = key === 'measure_interval_min' ? 0x0201 : 0x0202;
+            await firstEndpoint.write('genBasic', {[attrId]: {value: Math.round(value), type: 0x21}});
+            return {state: {[key]: value}};
+        },
+        convertGet: async (entity, key, meta) => {
+            const firstEndpoint = meta.device.getEndpoint(1);
+            await firstEndpoint.read('genBasic', [0x0201, 0x0202, 0x0203, 0x0204]);
+        },
+    },
 };
 
 const device = {
@@ -89,10 +359,25 @@ const device = {
             fromZigbeeConverters.battery,
             fromZigbeeConverters.diyruz_contact,
             fromZigbeeConverters.occupancy,
+            fz.bme280_profile,
+            fz.ldr_calibration,
+            fz.report_statistics,
+            fz.occupancy_trigger,
+            fz.occupancy_custom,
+            fz.metering,
+            fz.contact_mode,
 //            fz.occupancy_sensor_type,
         ],
         toZigbee: [
             tz.occupancy_timeout,
+            tz.occupancy_trigger,
+            tz.light_control,
+            tz.contact_mode,
+            tz.contact_bounces,
+            tz.metering,
+            tz.bme280_profile,
+            tz.ldr_calibration,
+            tz.measure_interval,
             toZigbeeConverters.factory_reset,
         ],
         meta: {
@@ -113,6 +398,7 @@ const device = {
             ]);
             await bind(secondEndpoint, coordinatorEndpoint, [
                 'genOnOff',
+                'seMetering',
             ]);
             await bind(thirdEndpoint, coordinatorEndpoint, [
                 'msOccupancySensing',
@@ -131,21 +417,34 @@ const device = {
                 attribute: 'batteryPercentageRemaining',
                 minimumReportInterval: 0,
                 maximumReportInterval: 3600,
-                reportableChange: 0,
+                reportableChange: 2,
             }
         ];
 
-        const msBindPayload = [{
+        // the device reports on reportableChange, these replace its defaults
+        const msTemperatureBindPayload = [{
             attribute: 'measuredValue',
-            minimumReportInterval: 0,
+            minimumReportInterval: 10,
             maximumReportInterval: 3600,
-            reportableChange: 0,
+            reportableChange: 50,
         }];
-        const msTemperatureBindPayload = [{
+        const msHumidityBindPayload = [{
             attribute: 'measuredValue',
-            minimumReportInterval: 0,
+            minimumReportInterval: 10,
             maximumReportInterval: 3600,
-            reportableChange: 0,
+            reportableChange: 1000,
+        }];
+        const msPressureBindPayload = [{
+            attribute: 'measuredValue',
+            minimumReportInterval: 10,
+            maximumReportInterval: 3600,
+            reportableChange: 1,
+        }];
+        const msIlluminanceBindPayload = [{
+            attribute: 'measuredValue',
+            minimumReportInterval: 10,
+            maximumReportInterval: 3600,
+            reportableChange: 414,
         }];
         const genOnOffBindPayload = [{
             attribute: 'onOff',
@@ -162,24 +461,49 @@ const device = {
 
             await firstEndpoint.configureReporting('genPowerCfg', genPowerCfgPayload);
             await firstEndpoint.configureReporting('msTemperatureMeasurement', msTemperatureBindPayload);
-            await firstEndpoint.configureReporting('msRelativeHumidity', msBindPayload);
-            await firstEndpoint.configureReporting('msPressureMeasurement', msBindPayload);
-            await firstEndpoint.configureReporting('msIlluminanceMeasurement', msBindPayload);
+            await firstEndpoint.configureReporting('msRelativeHumidity', msHumidityBindPayload);
+            await firstEndpoint.configureReporting('msPressureMeasurement', msPressureBindPayload);
+            await firstEndpoint.configureReporting('msIlluminanceMeasurement', msIlluminanceBindPayload);
             await secondEndpoint.configureReporting('genOnOff', genOnOffBindPayload);
             await thirdEndpoint.configureReporting('msOccupancySensing', msOccupancySensingBindPayload);
-            await fourthEndpoint.configureReporting('msIlluminanceMeasurement', msBindPayload);
+            await fourthEndpoint.configureReporting('msIlluminanceMeasurement', msIlluminanceBindPayload);
         },
         exposes: [
             exposes.numeric('battery', ACCESS_STATE).withUnit('%').withDescription('Remaining battery in %').withValueMin(0).withValueMax(100),
             exposes.numeric('temperature_1', ACCESS_STATE).withUnit('°C').withDescription('Measured temperature value'), 
             exposes.numeric('humidity', ACCESS_STATE).withUnit('%').withDescription('Measured relative humidity'),
             exposes.numeric('pressure', ACCESS_STATE).withUnit('hPa').withDescription('The measured atmospheric pressure'),
-            exposes.numeric('illuminance_1', ACCESS_STATE).withDescription('Raw measured illuminance LDR'), 
+            exposes.numeric('illuminance_1', ACCESS_STATE).withUnit('lx').withDescription('Measured illuminance in lux LDR'),
             exposes.numeric('illuminance_4', ACCESS_STATE).withUnit('lx').withDescription('Measured illuminance in lux BH1750'),
             exposes.binary('contact', ACCESS_STATE).withDescription('Indicates if the contact is closed (= true) or open (= false)'), 
+            exposes.enum('contact_mode', ACCESS_STATE | ACCESS_WRITE | ACCESS_READ, contactModes).withDescription('Contact input as open/closed or as pulse counter of a gas or water meter'),
+            exposes.numeric('contact_bounces', ACCESS_STATE | ACCESS_READ).withDescription('Bounces the glitch filter dropped in the previous contact change'),
+            exposes.numeric('volume', ACCESS_STATE | ACCESS_WRITE | ACCESS_READ).withUnit('m³').withDescription('Meter reading in pulses mode, write to match the meter'),
+            exposes.numeric('flow', ACCESS_STATE).withUnit('m³/h').withDescription('Flow over the last batch of pulses'),
+            exposes.numeric('meter_pulses', ACCESS_STATE).withDescription('Pulses counted in total'),
+            exposes.numeric('meter_multiplier', ACCESS_STATE | ACCESS_WRITE | ACCESS_READ).withDescription('Volume per pulse is multiplier / divisor').withValueMin(1).withValueMax(16777215),
+            exposes.numeric('meter_divisor', ACCESS_STATE | ACCESS_WRITE | ACCESS_READ).withDescription('Volume per pulse is multiplier / divisor').withValueMin(1).withValueMax(16777215),
             exposes.binary('occupancy', ACCESS_STATE).withDescription('Indicates whether the device detected occupancy'), 
 //            exposes.numeric('occupancy_sensor_type', ACCESS_STATE).withDescription('occupancy_sensor_type'),
-            exposes.numeric('occupancy_timeout', ACCESS_STATE | ACCESS_WRITE | ACCESS_READ).withUnit('sec').withDescription('Delay occupied to unoccupied + 10 sec adaptation'),
+            exposes.numeric('occupancy_timeout', ACCESS_STATE | ACCESS_WRITE | ACCESS_READ).withUnit('sec').withDescription('Delay occupied to unoccupied after the last motion'),
+            exposes.numeric('occupancy_trigger_window', ACCESS_STATE | ACCESS_WRITE | ACCESS_READ).withUnit('sec').withDescription('Window the motion edges of the threshold have to fall into').withValueMin(0).withValueMax(65535),
+            exposes.numeric('occupancy_trigger_threshold', ACCESS_STATE | ACCESS_WRITE | ACCESS_READ).withDescription('Motion edges within the window before occupied is reported').withValueMin(1).withValueMax(254),
+            exposes.enum('bme280_profile', ACCESS_STATE | ACCESS_WRITE | ACCESS_READ, bme280Profiles).withDescription('BME280 oversampling and filter profile'),
+            exposes.numeric('bme280_conversion_time', ACCESS_STATE).withUnit('ms').withDescription('BME280 conversion time of the selected profile'),
+            exposes.numeric('ldr_raw_adc', ACCESS_STATE).withDescription('Raw LDR divider ADC reading'),
+            exposes.numeric('ldr_calibration_offset', ACCESS_STATE | ACCESS_WRITE | ACCESS_READ).withDescription('LDR offset in 10000 * log10(lux) units').withValueMin(-20000).withValueMax(20000),
+            exposes.numeric('ldr_calibration_gain', ACCESS_STATE | ACCESS_WRITE | ACCESS_READ).withDescription('LDR curve gain, 1 keeps the default curve').withValueMin(0).withValueMax(15),
+            exposes.numeric('ldr_excitation_charge', ACCESS_STATE).withUnit('nC').withDescription('Charge drawn by the LDR divider since boot'),
+            exposes.binary('ldr_auto_calibration', ACCESS_STATE | ACCESS_WRITE | ACCESS_READ, true, false).withDescription('Calibrate the LDR offset against the BH1750'),
+            exposes.numeric('bme280_sample_charge', ACCESS_STATE).withUnit('nC').withDescription('BME280 estimated charge per sample of the selected profile'),
+            exposes.numeric('measure_interval_min', ACCESS_STATE | ACCESS_WRITE | ACCESS_READ).withUnit('sec').withDescription('Shortest measurement interval, used while readings move').withValueMin(1).withValueMax(3600),
+            exposes.numeric('measure_interval_max', ACCESS_STATE | ACCESS_WRITE | ACCESS_READ).withUnit('sec').withDescription('Longest measurement interval, used while readings are stable').withValueMin(1).withValueMax(3600),
+            exposes.numeric('measure_interval', ACCESS_STATE).withUnit('sec').withDescription('Current measurement interval'),
+            exposes.numeric('wakeups_per_hour', ACCESS_STATE).withDescription('Scheduled wakeups in the last full hour'),
+            exposes.numeric('motion_latency', ACCESS_STATE).withUnit('us').withDescription('Last PIR edge to occupancy report latency'),
+            exposes.numeric('motion_latency_max', ACCESS_STATE).withUnit('us').withDescription('Longest PIR edge to occupancy report latency since boot'),
+            exposes.enum('light_control', ACCESS_STATE | ACCESS_WRITE | ACCESS_READ, lightControlModes).withDescription('Switch the lights bound to endpoint 3 genOnOff on occupancy, without the coordinator'),
+            exposes.numeric('light_illuminance_max', ACCESS_STATE | ACCESS_WRITE | ACCESS_READ).withUnit('lx').withDescription('Lights stay off above this BH1750 illuminance, 0 - always on').withValueMin(0).withValueMax(100000),
         ],
 };
 
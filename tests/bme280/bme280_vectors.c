@@ -0,0 +1,83 @@
+/*
+ * Host check of the BME280 compensation against the Bosch reference
+ * values, builds bme280spi.c as it is with the target headers stubbed.
+ *
+ * Temperature and pressure: the worked example of the BMP280 datasheet
+ * (BST-BMP280-DS001, 3.12), the BME280 uses the same formulas for both.
+ * t_fine 128422, 25.08 degC and 100653.27 Pa in double precision. The
+ * integer path follows the 32-bit reference, which returns Pa instead of
+ * the Q24.8 of the 64-bit one, and gives 100656 Pa for the same input.
+ *
+ * Humidity: the datasheet has no worked example, the calibration below
+ * is from a BME280 sample and the value is the double precision result.
+ * Both paths have to hit it within 0.01 %RH.
+ */
+#include "hal_types.h"
+
+uint8 P1_2, P1SEL, P1DIR;
+
+#include "bme280spi.c"
+
+#include <stdio.h>
+#include <string.h>
+
+void HalSpiDmaInit(void) {}
+void HalSpiDmaRelease(void) {}
+uint8 HalSpiDmaTransfer(const halSpiDmaDevice_t *dev, halSpiDmaXfer_t *xfer) {
+    if (xfer->rx != NULL) {
+        memset(xfer->rx, 0, xfer->len);
+    }
+    return HAL_SPI_DMA_SUCCESS;
+}
+bool HalSpiDmaPoll(void) { return TRUE; }
+void HalSpiDmaWait(void) {}
+void HalDelayUs(uint16 microSecs) {}
+uint8 osal_nv_item_init(uint16 id, uint16 len, void *buf) { return ZSUCCESS; }
+uint8 osal_nv_read(uint16 id, uint16 offset, uint16 len, void *buf) { return ZSUCCESS; }
+uint8 osal_nv_write(uint16 id, uint16 offset, uint16 len, void *buf) { return ZSUCCESS; }
+
+static int failures = 0;
+
+static void check(const char *what, long value, long expected, long tolerance) {
+    long error = value - expected;
+    bool ok = error <= tolerance && error >= -tolerance;
+
+    printf("%-12s %10ld expected %10ld +-%ld %s\n", what, value, expected, tolerance, ok ? "ok" : "FAIL");
+    if (!ok) {
+        failures++;
+    }
+}
+
+int main(void) {
+    static const bme280_calib_t datasheet = {27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000};
+    static const bme280_calib_t sample = {28485, 26469, 50,    36895, -10603, 3024, 5654, -127, -7, 9900, -10230, 4285,
+                                          75,    362,   0,     313,   50,     30};
+    bme280_raw_t raw;
+    bme280_data_t data;
+
+#ifdef BME280_FLOAT_COMPENSATION
+    long pressure = 100653;
+    printf("double precision compensation\n");
+#else
+    long pressure = 100656;
+    printf("integer compensation\n");
+#endif
+
+    bme280_calib = datasheet;
+    raw.adc_T = 519888;
+    raw.adc_P = 415148;
+    raw.adc_H = 0x8000;
+    bme280_compensate(&raw, &data);
+    check("t_fine", t_fine, 128422, 0);
+    check("temperature", data.temperature, 2508, 0);
+    check("pressure", (long)data.pressure, pressure, 0);
+
+    bme280_calib = sample;
+    raw.adc_T = 519888;
+    raw.adc_P = 415148;
+    raw.adc_H = 31000;
+    bme280_compensate(&raw, &data);
+    check("humidity", data.humidity, 6032, 1);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,7 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#define LREP(...)
+#define LREPMaster(x)
+
+#endif
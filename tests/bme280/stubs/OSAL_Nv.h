@@ -0,0 +1,10 @@
+#ifndef OSAL_NV_H
+#define OSAL_NV_H
+
+#include "hal_types.h"
+
+extern uint8 osal_nv_item_init(uint16 id, uint16 len, void *buf);
+extern uint8 osal_nv_read(uint16 id, uint16 offset, uint16 len, void *buf);
+extern uint8 osal_nv_write(uint16 id, uint16 offset, uint16 len, void *buf);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef ZCOMDEF_H
+#define ZCOMDEF_H
+
+#include "hal_types.h"
+#include "hal_defs.h"
+
+#define ZSUCCESS 0
+
+// Source/preinclude.h
+#define NW_BME280_CALIB 0x0402
+
+#endif
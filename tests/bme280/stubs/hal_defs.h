@@ -0,0 +1,7 @@
+#ifndef HAL_DEFS_H
+#define HAL_DEFS_H
+
+#define BV(n) (1 << (n))
+#define st(x) do { x } while (0)
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef HAL_TYPES_H
+#define HAL_TYPES_H
+
+#include <stddef.h>
+
+// the 8051 widths on an LP64 host
+typedef signed char int8;
+typedef unsigned char uint8;
+typedef short int16;
+typedef unsigned short uint16;
+typedef int int32;
+typedef unsigned int uint32;
+typedef uint8 bool;
+
+#define TRUE 1
+#define FALSE 0
+
+// Source/stdint.h maps the C99 names onto the types above
+#include "stdint.h"
+
+#endif
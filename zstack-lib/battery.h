@@ -17,5 +17,6 @@ extern uint8 getBatteryRemainingPercentageZCLCR2032(uint16 volt16);
 extern void zclBattery_Init(uint8 task_id);
 extern uint16 zclBattery_event_loop(uint8 task_id, uint16 events);
 extern void zclBattery_HandleKeys(uint8 portAndAction, uint8 keyCode);
+extern void zclBattery_Measure(void);
 extern void zclBattery_Report(void);
 #endif
\ No newline at end of file
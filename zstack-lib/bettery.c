@@ -47,7 +47,7 @@ uint8 getBatteryVoltageZCL(uint16 millivolts) {
 // return millivolts
 uint16 getBatteryVoltage(void) {
     HalAdcSetReference(HAL_ADC_REF_125V);
-    zclBattery_RawAdc = adcReadSampled(HAL_ADC_CHANNEL_VDD, HAL_ADC_RESOLUTION_14, HAL_ADC_REF_125V, 10);
+    zclBattery_RawAdc = adcReadSampled(HAL_ADC_CHANNEL_VDD, HAL_ADC_RESOLUTION_14, HAL_ADC_REF_125V, 10, ADC_REDUCE_TRIMMED);
     return (uint16)(zclBattery_RawAdc * MULTI);
 }
 
@@ -71,12 +71,16 @@ uint8 getBatteryRemainingPercentageZCLCR2032(uint16 volt16) {
     return (uint8)(battery_level * 2);
 }
 
-void zclBattery_Report(void) {
+void zclBattery_Measure(void) {
     uint16 millivolts = getBatteryVoltage();
     zclBattery_Voltage = getBatteryVoltageZCL(millivolts);
     zclBattery_PercentageRemainig = ZCL_BATTERY_REPORT_REPORT_CONVERTER(millivolts);
 
     LREP("Battery voltageZCL=%d prc=%d voltage=%d\r\n", zclBattery_Voltage, zclBattery_PercentageRemainig, millivolts);
+}
+
+void zclBattery_Report(void) {
+    zclBattery_Measure();
 
 #if BDB_REPORTING
     bdb_RepChangedAttrValue(1, POWER_CFG, ATTRID_POWER_CFG_BATTERY_PERCENTAGE_REMAINING);
@@ -3,6 +3,7 @@
 #include "OSAL_PwrMgr.h"
 #include "ZDApp.h"
 #include "bdb_interface.h"
+#include "nwk.h"
 #include "hal_key.h"
 #include "hal_led.h"
 
@@ -110,6 +111,18 @@ static void zclCommissioning_ProcessIncomingMsg(zclIncomingMsg_t *pInMsg) {
     }
 }
 
+/*
+ * Single data request to the parent, the poll rate is 0 while sleeping
+ * so nothing else fetches the data queued for us
+ */
+void zclCommissioning_Poll(void) {
+#if ZG_BUILD_ENDDEVICE_TYPE
+    if (devState == DEV_END_DEVICE) {
+        NwkPollReq(FALSE);
+    }
+#endif
+}
+
 void zclCommissioning_Sleep(uint8 allow) {
     LREP("zclCommissioning_Sleep %d\r\n", allow);
 #if defined(POWER_SAVING)
@@ -1,5 +1,6 @@
 #include "ds18b20.h"
 #include "OnBoard.h"
+#include "hal_delay.h"
 
 #define DS18B20_SKIP_ROM 0xCC
 #define DS18B20_CONVERT_T 0x44
@@ -24,8 +25,6 @@
 
 #define DS18B20_RETRY_DELAY ((uint16) (MAX_CONVERSION_TIME / DS18B20_RETRY_COUNT))
 
-static void _delay_us(uint16);
-static void _delay_ms(uint16);
 static void ds18b20_send(uint8);
 static uint8 ds18b20_read(void);
 static void ds18b20_send_byte(int8);
@@ -35,30 +34,20 @@ static void ds18b20_GroudPins(void);
 static void ds18b20_setResolution(uint8 resolution);
 static int16 ds18b20_convertTemperature(uint8 temp1, uint8 temp2, uint8 resolution);
 
-static void _delay_us(uint16 microSecs) {
-    MicroWait(microSecs);
-}
-
-static void _delay_ms(uint16 milliSecs) {
-    while (milliSecs--) {
-        _delay_us(1000);
-    }
-}
-
 // Sends one bit to bus
 static void ds18b20_send(uint8 bit) {
     TSENS_SBIT = 1;
     TSENS_DIR |= TSENS_BV; // output
     TSENS_SBIT = 0;
     if (bit != 0)
-        _delay_us(8);
+        HalDelayUs(8);
     else
-        _delay_us(80);
+        HalDelayUs(80);
     TSENS_SBIT = 1;
     if (bit != 0)
-        _delay_us(80);
+        HalDelayUs(80);
     else
-        _delay_us(2);
+        HalDelayUs(2);
     // TSENS_SBIT = 1;
 }
 
@@ -67,13 +56,13 @@ static uint8 ds18b20_read(void) {
     TSENS_SBIT = 1;
     TSENS_DIR |= TSENS_BV; // output
     TSENS_SBIT = 0;
-    _delay_us(2);
+    HalDelayUs(2);
     // TSENS_SBIT = 1;
-    //_delay_us(15);
+    //HalDelayUs(15);
     TSENS_DIR &= ~TSENS_BV; // input
-    _delay_us(5);
+    HalDelayUs(5);
     uint8 i = TSENS_SBIT;
-    _delay_us(60);
+    HalDelayUs(60);
     return i;
 }
 
@@ -85,7 +74,7 @@ static void ds18b20_send_byte(int8 data) {
         x &= 0x01;
         ds18b20_send(x);
     }
-    //_delay_us(100);
+    //HalDelayUs(100);
 }
 
 // Reads one byte from bus
@@ -95,7 +84,7 @@ static uint8 ds18b20_read_byte(void) {
     for (i = 0; i < 8; i++) {
         if (ds18b20_read())
             data |= 0x01 << i;
-        //_delay_us(25);
+        //HalDelayUs(25);
     }
     return (data);
 }
@@ -104,14 +93,14 @@ static uint8 ds18b20_read_byte(void) {
 static uint8 ds18b20_Reset(void) {
     TSENS_SBIT = 0;
     TSENS_DIR |= TSENS_BV; // output
-    _delay_us(600);
+    HalDelayUs(600);
     TSENS_DIR &= ~TSENS_BV; // input
-    _delay_us(70);
+    HalDelayUs(70);
     uint8 i = TSENS_SBIT;
-    _delay_us(200);
+    HalDelayUs(200);
     TSENS_SBIT = 1;
     TSENS_DIR |= TSENS_BV; // output
-    _delay_us(600);
+    HalDelayUs(600);
     return i;
 }
 
@@ -175,7 +164,7 @@ int16 readTemperature(void) {
     ds18b20_send_byte(DS18B20_CONVERT_T);
 
     while (retry_count) {
-        _delay_ms(DS18B20_RETRY_DELAY);
+        HalDelayMs(DS18B20_RETRY_DELAY);
         ds18b20_Reset();
         ds18b20_send_byte(DS18B20_SKIP_ROM);
         ds18b20_send_byte(DS18B20_READ_SCRATCHPAD);
@@ -0,0 +1,76 @@
+#include "hal_adc_dma.h"
+
+#include "hal_adc.h"
+#include "hal_board.h"
+#include "hal_delay.h"
+#include "hal_dma.h"
+#include "hal_mcu.h"
+#include "ioCC2530.h"
+
+// the channel is shared with the SPI transport, both wait for their
+// transfer to finish before returning
+#ifndef HAL_ADC_DMA_CH
+#define HAL_ADC_DMA_CH 2
+#endif
+
+#define HAL_ADC_DMA_ADCL 0x70BA // ADCL as seen from XDATA space, ADCH follows
+
+/* ADCCON1 */
+#define HAL_ADC_DMA_STSEL_FULL_SPEED 0x10
+#define HAL_ADC_DMA_STSEL_ST         0x30 // reset value, waits for ADCCON1.ST
+#define HAL_ADC_DMA_RESERVED         0x03 // always write 11
+
+#define HAL_ADC_DMA_ARMED() (DMAARM & BV(HAL_ADC_DMA_CH))
+
+void HalAdcDmaSample(uint8 channel, uint8 resolution, uint8 reference, uint16 *samples, uint8 count) {
+  halDMADesc_t *ch;
+  uint8 apcfg = APCFG;
+  // HAL_ADC_RESOLUTION_8..14 is decimation 64..512 and a left aligned result
+  uint8 decimation = (uint8)((resolution - HAL_ADC_RESOLUTION_8) << 4);
+  uint8 shift = (uint8)(8 - 2 * (resolution - HAL_ADC_RESOLUTION_8));
+  uint8 i;
+
+  if (count == 0 || count > HAL_ADC_DMA_SAMPLES_MAX) {
+    return;
+  }
+
+  ch = HAL_DMA_GET_DESC1234(HAL_ADC_DMA_CH);
+  HAL_DMA_SET_SOURCE(ch, HAL_ADC_DMA_ADCL);
+  HAL_DMA_SET_DEST(ch, samples);
+  HAL_DMA_SET_VLEN(ch, HAL_DMA_VLEN_USE_LEN);
+  HAL_DMA_SET_LEN(ch, count);
+  HAL_DMA_SET_WORD_SIZE(ch, HAL_DMA_WORDSIZE_WORD);
+  HAL_DMA_SET_TRIG_MODE(ch, HAL_DMA_TMODE_SINGLE);
+  HAL_DMA_SET_TRIG_SRC(ch, HAL_DMA_TRIG_ADC_CHALL);
+  HAL_DMA_SET_SRC_INC(ch, HAL_DMA_SRCINC_0);
+  HAL_DMA_SET_DST_INC(ch, HAL_DMA_DSTINC_1);
+  HAL_DMA_SET_IRQ(ch, HAL_DMA_IRQMASK_ENABLE);
+  HAL_DMA_SET_M8(ch, HAL_DMA_M8_USE_8_BITS);
+  HAL_DMA_SET_PRIORITY(ch, HAL_DMA_PRI_HIGH);
+
+  HAL_DMA_CLEAR_IRQ(HAL_ADC_DMA_CH);
+  HAL_DMA_ARM_CH(HAL_ADC_DMA_CH);
+  HAL_DELAY_DMA_ARM();
+  DMAIE = 1;
+
+  // a sequence skips the inputs that are not enabled in APCFG, channels
+  // above 7 (VDD/3, temperature) are converted alone anyway
+  APCFG = (channel < 8) ? BV(channel) : 0;
+  ADCCON2 = reference | decimation | channel;
+  ADCCON1 = HAL_ADC_DMA_STSEL_FULL_SPEED | HAL_ADC_DMA_RESERVED;
+
+  // idle until the DMA (or any other) interrupt
+  HAL_DELAY_IDLE_WHILE(HAL_ADC_DMA_ARMED());
+
+  ADCCON1 = HAL_ADC_DMA_STSEL_ST | HAL_ADC_DMA_RESERVED;
+  HAL_DMA_CLEAR_IRQ(HAL_ADC_DMA_CH);
+  APCFG = apcfg;
+  // drop a conversion that finished after the last transfer
+  (void)ADCL;
+  (void)ADCH;
+
+  for (i = 0; i < count; i++) {
+    // negative results of a single ended input are noise around 0
+    samples[i] = (samples[i] & 0x8000) ? 0 : (samples[i] >> shift);
+  }
+}
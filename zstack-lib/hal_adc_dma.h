@@ -0,0 +1,29 @@
+#ifndef HAL_ADC_DMA_H
+#define HAL_ADC_DMA_H
+
+#include "hal_types.h"
+
+/*
+  ADC sequence conversion into a buffer
+
+  The ADC runs in full speed sequence mode on a single channel (the only
+  one enabled in APCFG), every conversion result is moved by DMA, the CPU
+  idles until the buffer is full. One conversion takes 132 us at 14 bit,
+  see HAL_ADC_RESOLUTION_* in hal_adc.h.
+*/
+
+#define HAL_ADC_DMA_SAMPLES_MAX 16
+
+/*********************************************************************
+ * @fn      HalAdcDmaSample
+ * @brief   Converts channel count times back to back
+ * @param   channel - HAL_ADC_CHANNEL_0..7 or HAL_ADC_CHANNEL_VDD
+ * @param   resolution - HAL_ADC_RESOLUTION_*
+ * @param   reference - HAL_ADC_REF_*
+ * @param   samples - target buffer, right aligned results like HalAdcRead
+ * @param   count - number of samples, up to HAL_ADC_DMA_SAMPLES_MAX
+ * @return  void
+ */
+extern void HalAdcDmaSample(uint8 channel, uint8 resolution, uint8 reference, uint16 *samples, uint8 count);
+
+#endif
@@ -0,0 +1,95 @@
+#include "hal_delay.h"
+
+#include "Debug.h"
+#include "hal_mcu.h"
+#include "ioCC2530.h"
+
+#define HAL_DELAY_MS_TO_TICKS(ms) (((uint32)(ms) * 4096) / 125) // 32768 / 1000
+
+#define HAL_DELAY_SELF_TEST_US 10000
+
+static void halDelaySetCompare(uint32 ticks);
+static bool halDelayBefore(uint32 target);
+
+/*********************************************************************
+ * @fn      HalDelaySleepTimer
+ * @brief   ST0 has to be read first, it latches ST1 and ST2
+ */
+uint32 HalDelaySleepTimer(void) {
+  uint32 ticks = ST0;
+  ticks |= (uint32)ST1 << 8;
+  ticks |= (uint32)ST2 << 16;
+  return ticks;
+}
+
+/*********************************************************************
+ * @fn      halDelaySetCompare
+ * @brief   Writing ST0 loads the new compare value
+ */
+static void halDelaySetCompare(uint32 ticks) {
+  while (!(STLOAD & 0x01))
+    ;
+  ST2 = (uint8)(ticks >> 16);
+  ST1 = (uint8)(ticks >> 8);
+  ST0 = (uint8)ticks;
+}
+
+/*********************************************************************
+ * @fn      halDelayBefore
+ * @brief   The sleep timer hasn't reached the target yet
+ */
+static bool halDelayBefore(uint32 target) {
+  uint32 remaining = (target - HalDelaySleepTimer()) & HAL_DELAY_ST_MASK;
+  return remaining != 0 && remaining < HAL_DELAY_ST_HALF;
+}
+
+void HalDelayUs(uint16 microSecs) {
+  // one iteration is 1 us at 32 MHz, CLKSPD divides the system clock
+  microSecs >>= (CLKCONSTA & 0x07);
+  while (microSecs--) {
+    HAL_DELAY_CYCLES(32 - HAL_DELAY_LOOP_CYCLES);
+  }
+}
+
+void HalDelayMs(uint16 milliSecs) {
+  uint32 target;
+  uint8 stie = STIE;
+
+  if (!EA) {
+    // during the stack init nothing would wake us up
+    while (milliSecs--) {
+      HalDelayUs(1000);
+    }
+    return;
+  }
+
+  target = (HalDelaySleepTimer() + HAL_DELAY_MS_TO_TICKS(milliSecs)) & HAL_DELAY_ST_MASK;
+  halDelaySetCompare(target);
+  STIE = 1;
+
+  HAL_DELAY_IDLE_WHILE(halDelayBefore(target));
+
+  STIE = stie;
+}
+
+int16 HalDelaySelfTest(void) {
+  halIntState_t intState;
+  uint32 start, ticks;
+  uint8 st0;
+  int16 error;
+
+  HAL_ENTER_CRITICAL_SECTION(intState);
+  // start right at a sleep timer edge
+  st0 = ST0;
+  while (ST0 == st0)
+    ;
+  start = HalDelaySleepTimer();
+  HalDelayUs(HAL_DELAY_SELF_TEST_US);
+  ticks = (HalDelaySleepTimer() - start) & HAL_DELAY_ST_MASK;
+  HAL_EXIT_CRITICAL_SECTION(intState);
+
+  // ticks * 1000000 / 32768 - HAL_DELAY_SELF_TEST_US, in permille of HAL_DELAY_SELF_TEST_US
+  error = (int16)(((int32)(ticks * 15625 / 512) - HAL_DELAY_SELF_TEST_US) / (HAL_DELAY_SELF_TEST_US / 1000));
+  LREP("HalDelaySelfTest ticks=%ld error=%d permille\r\n", ticks, error);
+  return error;
+}
@@ -0,0 +1,99 @@
+#ifndef HAL_DELAY_H
+#define HAL_DELAY_H
+
+#include "hal_types.h"
+#include "hal_defs.h"
+
+/*
+  Delays for bit-banged buses and sensor start-up times.
+
+  HAL_DELAY_CYCLES - cycle exact, folded by the compiler from a constant (< 32)
+  HalDelayUs       - busy wait, follows the current system clock (32 MHz XOSC / 16 MHz RC)
+  HalDelayMs       - CPU idles until the sleep timer compare fires
+  HalDelaySleepTimer - 32 kHz time stamp, keeps running in PM2, safe in ISRs
+  HAL_DELAY_IDLE_WHILE - CPU idles until an interrupt makes the condition false
+
+  Waits that can be split should rather use osal_start_timerEx, only then
+  the power manager can take the device to PM2.
+*/
+
+// cycles spent per HalDelayUs iteration outside of the NOPs, check with HalDelaySelfTest
+#ifndef HAL_DELAY_LOOP_CYCLES
+#define HAL_DELAY_LOOP_CYCLES 8
+#endif
+
+#define HAL_DELAY_ST_MASK 0xFFFFFFUL // 24 bit sleep timer
+#define HAL_DELAY_ST_HALF 0x800000UL
+
+#define HAL_DELAY_TICKS_TO_US(ticks) ((uint32)(ticks) * 15625 / 512) // 1000000 / 32768, ticks < 274877
+
+#define HAL_DELAY_NOP4() st( asm("NOP"); asm("NOP"); asm("NOP"); asm("NOP"); )
+
+#define HAL_DELAY_CYCLES(n) st( \
+  if ((n) & 0x01) { asm("NOP"); } \
+  if ((n) & 0x02) { asm("NOP"); asm("NOP"); } \
+  if ((n) & 0x04) { HAL_DELAY_NOP4(); } \
+  if ((n) & 0x08) { HAL_DELAY_NOP4(); HAL_DELAY_NOP4(); } \
+  if ((n) & 0x10) { HAL_DELAY_NOP4(); HAL_DELAY_NOP4(); HAL_DELAY_NOP4(); HAL_DELAY_NOP4(); } \
+)
+
+// arming a DMA channel takes 9 system clocks
+#define HAL_DELAY_DMA_ARM() HAL_DELAY_CYCLES(9)
+
+// cond is checked with interrupts off, an interrupt is not taken in the
+// instruction right after EA is set, so one that makes cond false between
+// the check and PCON still wakes us up. Interrupts are off during the
+// stack init, then it just spins.
+#define HAL_DELAY_IDLE_WHILE(cond) st( \
+  halIntState_t _idleState; \
+  for (;;) { \
+    HAL_ENTER_CRITICAL_SECTION(_idleState); \
+    if (!(cond)) { \
+      HAL_EXIT_CRITICAL_SECTION(_idleState); \
+      break; \
+    } \
+    if (_idleState) { \
+      HAL_ENABLE_INTERRUPTS(); \
+      PCON = 0x01; \
+      asm("NOP"); \
+    } else { \
+      HAL_EXIT_CRITICAL_SECTION(_idleState); \
+    } \
+  } \
+)
+
+/*********************************************************************
+ * @fn      HalDelayUs
+ * @brief   Busy wait, keeps interrupts as they are
+ * @param   microSecs - time to wait
+ * @return  void
+ */
+extern void HalDelayUs(uint16 microSecs);
+
+/*********************************************************************
+ * @fn      HalDelayMs
+ * @brief   Wait on the sleep timer with the CPU in idle mode, falls
+ *          back to HalDelayUs while interrupts are disabled
+ * @param   milliSecs - time to wait
+ * @return  void
+ */
+extern void HalDelayMs(uint16 milliSecs);
+
+/*********************************************************************
+ * @fn      HalDelaySleepTimer
+ * @brief   Current sleep timer value, differences have to be masked
+ *          with HAL_DELAY_ST_MASK
+ * @param   void
+ * @return  32768 Hz ticks
+ */
+extern uint32 HalDelaySleepTimer(void);
+
+/*********************************************************************
+ * @fn      HalDelaySelfTest
+ * @brief   Measures HalDelayUs against the 32 kHz sleep timer
+ * @param   void
+ * @return  error in permille, positive if the delay is too long
+ */
+extern int16 HalDelaySelfTest(void);
+
+#endif
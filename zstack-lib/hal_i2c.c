@@ -40,9 +40,12 @@
 #include "hal_i2c.h"
 
 #include "Debug.h"
+#include "OSAL.h"
+#include "hal_mcu.h"
 #include "ioCC2530.h"
 #include "zcomdef.h"
 #include "utils.h"
+#include "hal_delay.h"
 
 #define STATIC static
 
@@ -68,62 +71,109 @@
 #define OCM_DATA_PIN 6
 #endif
 
+/*
+ * Bus timing in CPU cycles at 32 MHz, defaults aim at 400 kHz fast mode:
+ * tLOW >= 1.3 us, tHIGH >= 0.6 us, the bit code around the delays adds
+ * about 14 and 6 cycles. Slow rising edges of the internal pull-ups are
+ * covered for SCL by the clock stretching check, for SDA increase
+ * HAL_I2C_LOW_CYCLES (max 31).
+ */
+#ifndef HAL_I2C_LOW_CYCLES
+#define HAL_I2C_LOW_CYCLES 28
+#endif
 
+#ifndef HAL_I2C_HIGH_CYCLES
+#define HAL_I2C_HIGH_CYCLES 14
+#endif
 
-#define OCM_ADDRESS (0xA0)
+// polls of SCL while a slave stretches the clock, about 0.5 us each
+#ifndef HAL_I2C_STRETCH_TIMEOUT
+#define HAL_I2C_STRETCH_TIMEOUT 2000
+#endif
 
-#define SMB_ACK (0)
-#define SMB_NAK (1)
-#define SEND_STOP (0)
-#define NOSEND_STOP (1)
-#define SEND_START (0)
-#define NOSEND_START (1)
+#if OCM_CLK_PORT != OCM_DATA_PORT
+#error "bus sessions expect SCL and SDA on the same port"
+#endif
 
-// device specific as to where the 17th address bit goes...
+// time for the internal pull-ups / pull-downs to recharge the port inputs
+#ifndef HAL_I2C_SETTLE_US
+#define HAL_I2C_SETTLE_US 10
+#endif
 
 // *************************   MACROS   ************************************
 #undef P
 
-
-
 // OCM port I/O defintions
 #define OCM_SCL BNAME(OCM_CLK_PORT, OCM_CLK_PIN)
 #define OCM_SDA BNAME(OCM_DATA_PORT, OCM_DATA_PIN)
 
+#define OCM_PINS (BV(OCM_CLK_PIN) | BV(OCM_DATA_PIN))
+#define OCM_PUD_BIT BV(OCM_CLK_PORT + 5) // port pull direction in P2INP, set - pull down
 
+// registers of the bus port, P0 / P0IEN / P0IFG / P0IF / P0INP by default
+#define OCM_PORT CAT2(P, OCM_CLK_PORT)
+#define OCM_PORT_IEN PNAME(OCM_CLK_PORT, IEN)
+#define OCM_PORT_IFG PNAME(OCM_CLK_PORT, IFG)
+#define OCM_PORT_IF PNAME(OCM_CLK_PORT, IF)
+#define OCM_PORT_INP PNAME(OCM_CLK_PORT, INP)
 
-#define OCM_DATA_HIGH() { IO_DIR_PORT_PIN(OCM_DATA_PORT, OCM_DATA_PIN, IO_IN); }
-
-#define OCM_DATA_LOW()                                                                                                                     \
-    {                                                                                                                                      \
-        IO_DIR_PORT_PIN(OCM_DATA_PORT, OCM_DATA_PIN, IO_OUT);                                                                              \
-        OCM_SDA = 0;                                                                                                                       \
-    }
-
-
-
-STATIC void hali2cSend(uint8 *buffer, uint16 len, uint8 sendStart, uint8 sendStop);
-STATIC _Bool hali2cSendByte(uint8 dByte);
-STATIC void hali2cWrite(bool dBit);
-STATIC void hali2cClock(bool dir);
-STATIC void hali2cStart(void);
+/*
+ * Open drain emulation: port latches stay 0, a line is pulled low by
+ * switching its pin to output and released by switching back to input.
+ */
+#define OCM_CLK_LOW()      st( PNAME(OCM_CLK_PORT, DIR) |= BV(OCM_CLK_PIN); )
+#define OCM_CLK_RELEASE()  st( PNAME(OCM_CLK_PORT, DIR) &= ~BV(OCM_CLK_PIN); )
+#define OCM_DATA_LOW()     st( PNAME(OCM_DATA_PORT, DIR) |= BV(OCM_DATA_PIN); )
+#define OCM_DATA_HIGH()    st( PNAME(OCM_DATA_PORT, DIR) &= ~BV(OCM_DATA_PIN); )
+
+// release SCL and wait while a slave holds it low, stretch stays 0 once timed out
+#define OCM_CLK_HIGH() st( \
+    OCM_CLK_RELEASE(); \
+    while (!OCM_SCL && stretch) { \
+        stretch--; \
+    } \
+)
+
+#define HALI2C_TX_BIT(mask) st( \
+    if (dByte & (mask)) { \
+        OCM_DATA_HIGH(); \
+    } else { \
+        OCM_DATA_LOW(); \
+    } \
+    HAL_DELAY_CYCLES(HAL_I2C_LOW_CYCLES); \
+    OCM_CLK_HIGH(); \
+    HAL_DELAY_CYCLES(HAL_I2C_HIGH_CYCLES); \
+    OCM_CLK_LOW(); \
+)
+
+#define HALI2C_RX_BIT(mask) st( \
+    HAL_DELAY_CYCLES(HAL_I2C_LOW_CYCLES); \
+    OCM_CLK_HIGH(); \
+    HAL_DELAY_CYCLES(HAL_I2C_HIGH_CYCLES); \
+    if (OCM_SDA) { \
+        dByte |= (mask); \
+    } \
+    OCM_CLK_LOW(); \
+)
+
+STATIC int8 hali2cStart(void);
 STATIC void hali2cStop(void);
-STATIC void hali2cReceive(uint8 address, uint8 *buffer, uint16 len);
-STATIC uint8 hali2cReceiveByte(void);
-STATIC _Bool hali2cRead(void);
-STATIC void hali2cSendDeviceAddress(uint8 address);
-
-STATIC __near_func void hali2cWait(uint8);
+STATIC int8 hali2cSendByte(uint8 dByte);
+STATIC int8 hali2cReceiveByte(uint8 *pByte, bool ack);
+STATIC int8 hali2cSendDeviceAddress(uint8 address);
+STATIC void hali2cGroudPins(void);
 
-static void hali2cGroudPins(void);
+STATIC uint8 s_xmemIsInit;
+STATIC uint8 s_sessionDepth;
+STATIC uint8 s_maskedIen;   // port inputs kept quiet during the session
+STATIC uint8 s_maskedLevel; // their level before the session
+STATIC bool s_pudFlipped;   // port was pulled down before the session
 
 void hali2cGroudPins(void) {
-    IO_DIR_PORT_PIN(OCM_DATA_PORT, OCM_DATA_PIN, IO_IN);
-    IO_DIR_PORT_PIN(OCM_CLK_PORT, OCM_CLK_PIN, IO_IN);
+    OCM_DATA_HIGH();
+    OCM_CLK_RELEASE();
 }
 
-STATIC uint8 s_xmemIsInit;
-
 /*********************************************************************
  * @fn      HalI2CInit
  * @brief   Initializes two-wire serial I/O bus
@@ -134,304 +184,292 @@ void HalI2CInit(void) {
     if (!s_xmemIsInit) {
         s_xmemIsInit = 1;
 
-        // // Set port pins as inputs
-        // IO_DIR_PORT_PIN(OCM_CLK_PORT, OCM_CLK_PIN, IO_IN);
-        // IO_DIR_PORT_PIN(OCM_DATA_PORT, OCM_DATA_PIN, IO_IN);
-        // //
-        // // Set for general I/O operation
-        // IO_FUNC_PORT_PIN(OCM_CLK_PORT, OCM_CLK_PIN, IO_GIO);
-        // IO_FUNC_PORT_PIN(OCM_DATA_PORT, OCM_DATA_PIN, IO_GIO);
-        // //
-        // // Set I/O mode for pull-up/pull-down
-        // IO_IMODE_PORT_PIN(OCM_CLK_PORT, OCM_CLK_PIN, IO_PUD);
-        // IO_IMODE_PORT_PIN(OCM_DATA_PORT, OCM_DATA_PIN, IO_PUD);
-
-        // // Set pins to pull-up
-        // IO_PUD_PORT(OCM_CLK_PORT, IO_PUP);
-        // IO_PUD_PORT(OCM_DATA_PORT, IO_PUP);
+        // Set for general I/O operation, released lines
+        IO_FUNC_PORT_PIN(OCM_CLK_PORT, OCM_CLK_PIN, IO_GIO);
+        IO_FUNC_PORT_PIN(OCM_DATA_PORT, OCM_DATA_PIN, IO_GIO);
+        hali2cGroudPins();
+        // latches low, the direction registers do the signalling
+        OCM_SCL = 0;
+        OCM_SDA = 0;
+        // tri-state until the first session
+        OCM_PORT_INP |= OCM_PINS;
     }
 }
 
-int8 HalI2CReceive(uint8 address, uint8 *buf, uint16 len) {
-    hali2cReceive(address, buf, len);
-
-    return 0;
-}
+/*********************************************************************
+ * @fn      HalI2CAcquire
+ * @brief   Opens a bus session. The first user switches the port to
+ *          pull-up and enables the pulls on SCL/SDA, nested calls only
+ *          count. Interrupts of the other inputs of the port are masked
+ *          until HalI2CRelease, so neither the edges the pull change
+ *          causes nor an ISR following its input with the shared pull
+ *          direction (hal_key) get in between.
+ * @param   void
+ * @return  void
+ */
+void HalI2CAcquire(void) {
+    halIntState_t intState;
 
-int8 HalI2CSend(uint8 address, uint8 *buf, uint16 len) {   
-    hali2cSendDeviceAddress(address);
-    hali2cSend(buf, len, NOSEND_START, SEND_STOP);
+    if (s_sessionDepth++) {
+        return;
+    }
+    HalI2CInit();
+
+    HAL_ENTER_CRITICAL_SECTION(intState);
+    s_maskedIen = OCM_PORT_IEN & ~OCM_PINS;
+    // an edge still pending counts as a level change, its flag stays
+    s_maskedLevel = (OCM_PORT ^ OCM_PORT_IFG) & s_maskedIen;
+    OCM_PORT_IEN &= ~s_maskedIen;
+    s_pudFlipped = (P2INP & OCM_PUD_BIT) ? TRUE : FALSE;
+    if (s_pudFlipped) {
+        P2INP &= ~OCM_PUD_BIT;
+    }
+    OCM_PORT_INP &= ~OCM_PINS;
+    HAL_EXIT_CRITICAL_SECTION(intState);
 
-    return 0;
+    HalDelayUs(HAL_I2C_SETTLE_US);
 }
+
 /*********************************************************************
- * @fn      hali2cSend
- * @brief   Sends buffer contents to SM-Bus device
- * @param   buffer - ptr to buffered data to send
- * @param   len - number of bytes in buffer
- * @param   sendStart - whether or not to send start condition.
- * @param   sendStop - whether or not to send stop condition.
+ * @fn      HalI2CRelease
+ * @brief   Closes a bus session. The last user tri-states SCL/SDA, so
+ *          no current flows through the pulls while the bus is idle,
+ *          and restores the port pull direction. Masked inputs get
+ *          their interrupts back, flags are dropped for inputs that
+ *          ended up at their old level, the others are taken right
+ *          away and follow their new level.
+ * @param   void
  * @return  void
  */
-STATIC void hali2cSend(uint8 *buffer, uint16 len, uint8 sendStart, uint8 sendStop) {
-    uint16 i;
-    uint8 retry = HAL_I2C_RETRY_CNT;
+void HalI2CRelease(void) {
+    halIntState_t intState;
+    uint8 spurious;
 
-    if (!len) {
+    if (!s_sessionDepth || --s_sessionDepth) {
         return;
     }
 
-    if (sendStart == SEND_START) {
-        hali2cStart();
+    OCM_PORT_INP |= OCM_PINS;
+    if (s_pudFlipped) {
+        s_pudFlipped = FALSE;
+        P2INP |= OCM_PUD_BIT;
+        if (s_maskedIen) {
+            HalDelayUs(HAL_I2C_SETTLE_US);
+        }
     }
-
-    for (i = 0; i < len; i++) {
-        do {
-            if (hali2cSendByte(buffer[i])) // takes care of ack polling
-            {
-                break;
-            }
-        } while (--retry);
+    if (!s_maskedIen) {
+        // no interrupt to give back
+        return;
     }
 
-    if (sendStop == SEND_STOP) {
-        hali2cStop();
+    HAL_ENTER_CRITICAL_SECTION(intState);
+    spurious = s_maskedIen & ~(OCM_PORT ^ s_maskedLevel);
+    OCM_PORT_IFG = ~spurious;
+    OCM_PORT_IEN |= s_maskedIen;
+    if (!(OCM_PORT_IFG & OCM_PORT_IEN)) {
+        OCM_PORT_IF = 0;
     }
+    s_maskedIen = 0;
+    HAL_EXIT_CRITICAL_SECTION(intState);
 }
 
 /*********************************************************************
- * @fn      hali2cSendByte
- * @brief   Serialize and send one byte to SM-Bus device
- * @param   dByte - data byte to send
- * @return  ACK status - 0=none, 1=received
+ * @fn      HalI2CTransfer
+ * @brief   Runs a list of segments as one bus transaction
+ * @param   address: 7 bit slave address
+ * @param   segments: write/read segments, each one starts with a
+ *          (repeated) START and the address
+ * @param   count: number of segments
+ * @return  I2C_SUCCESS, I2C_ERROR on NACK, I2C_TIMEOUT on clock stretch timeout
  */
-STATIC _Bool hali2cSendByte(uint8 dByte) {
+int8 HalI2CTransfer(uint8 address, const halI2CSegment_t *segments, uint8 count) {
+    int8 status = I2C_SUCCESS;
+    bool started = FALSE;
     uint8 i;
+    uint16 n;
+
+    // a no-op inside a session, otherwise this is a session of its own
+    HalI2CAcquire();
+    for (i = 0; i < count && status == I2C_SUCCESS; i++) {
+        const halI2CSegment_t *seg = &segments[i];
+        bool read = (seg->flags & HAL_I2C_SEG_READ) != 0;
+
+        if (started) {
+            // repeated start, the previous segment left SCL low
+            OCM_DATA_HIGH();
+            HAL_DELAY_CYCLES(HAL_I2C_LOW_CYCLES);
+        }
+        status = hali2cSendDeviceAddress((address << 1) | (read ? OCM_READ : OCM_WRITE));
+        started = TRUE;
+
+        for (n = 0; n < seg->len && status == I2C_SUCCESS; n++) {
+            if (read) {
+                // NAK the last byte of the read
+                status = hali2cReceiveByte(&seg->buf[n], n + 1 < seg->len);
+            } else {
+                status = hali2cSendByte(seg->buf[n]);
+            }
+        }
 
-    for (i = 0; i < 8; i++) {
-        // Send the MSB
-        hali2cWrite(dByte & 0x80);
-        // Next bit into MSB
-        dByte <<= 1;
+        if (seg->flags & HAL_I2C_SEG_STOP) {
+            hali2cStop();
+            started = FALSE;
+        }
     }
-    
-    // need clock low so if the SDA transitions on the next statement the
-    // slave doesn't stop. Also give opportunity for slave to set SDA
-    hali2cClock(0);
-    OCM_DATA_HIGH(); // set to input to receive ack...
-    hali2cClock(1);
-    hali2cWait(1);
-
-    return (!OCM_SDA); // Return ACK status
-}
 
-/*********************************************************************
- * @fn      hali2cWrite
- * @brief   Send one bit to SM-Bus device
- * @param   dBit - data bit to clock onto SM-Bus
- * @return  void
- */
-STATIC void hali2cWrite(bool dBit) {
-    hali2cClock(0);
-    hali2cWait(1);
-    if (dBit) {
-        OCM_DATA_HIGH();
-    } else {
-        OCM_DATA_LOW();
+    if (started || status != I2C_SUCCESS) {
+        hali2cStop();
     }
+    HalI2CRelease();
+    return status;
+}
 
-    hali2cClock(1);
-    hali2cWait(1);
+int8 HalI2CReceive(uint8 address, uint8 *buf, uint16 len) {
+    halI2CSegment_t seg = {buf, len, HAL_I2C_SEG_READ};
+
+    return HalI2CTransfer(address >> 1, &seg, 1);
 }
 
-/*********************************************************************
- * @fn      hali2cClock
- * @brief   Clocks the SM-Bus. If a negative edge is going out, the
- *          I/O pin is set as an output and driven low. If a positive
- *          edge is going out, the pin is set as an input and the pin
- *          pull-up drives the line high. This way, the slave device
- *          can hold the node low if longer setup time is desired.
- * @param   dir - clock line direction
- * @return  void
- */
-STATIC void hali2cClock(bool dir) {
-    uint8 maxWait = 10;
-    if (dir) {
-        IO_DIR_PORT_PIN(OCM_CLK_PORT, OCM_CLK_PIN, IO_IN);
-        /* Wait until clock is high */
-        while (!OCM_SCL && maxWait) {
-            hali2cWait(1);
-            maxWait -= 1;
-        }
+int8 HalI2CSend(uint8 address, uint8 *buf, uint16 len) {
+    halI2CSegment_t seg = {buf, len, 0};
 
-    } else {
-        IO_DIR_PORT_PIN(OCM_CLK_PORT, OCM_CLK_PIN, IO_OUT);
-        OCM_SCL = 0;
-    }
-    hali2cWait(1);
+    return HalI2CTransfer(address >> 1, &seg, 1);
 }
 
 /*********************************************************************
  * @fn      hali2cStart
- * @brief   Initiates SM-Bus communication. Makes sure that both the
- *          clock and data lines of the SM-Bus are high. Then the data
- *          line is set high and clock line is set low to start I/O.
+ * @brief   START condition. Releases both lines, then pulls SDA low
+ *          while SCL is high and leaves SCL low.
  * @param   void
- * @return  void
+ * @return  I2C_TIMEOUT if a slave keeps SCL low
  */
-STATIC void hali2cStart(void) {
-    uint8 retry = HAL_I2C_RETRY_CNT;
-
-    // set SCL to input but with pull-up. if slave is pulling down it will stay down.
-    hali2cClock(1);
-
-    do {
-        // wait for slave to release clock line...
-        if (OCM_SCL) // wait until the line is high...
-        {
-            break;
-        }
-        hali2cWait(1);
-    } while (--retry);
+STATIC int8 hali2cStart(void) {
+    uint16 stretch = HAL_I2C_STRETCH_TIMEOUT;
 
-    // SCL low to set SDA high so the transition will be correct.
-    hali2cClock(0);
-    OCM_DATA_HIGH(); // SDA high
-    hali2cClock(1);  // set up for transition
-    hali2cWait(1);
+    OCM_DATA_HIGH();
+    OCM_CLK_HIGH();
+    if (!stretch) {
+        return I2C_TIMEOUT;
+    }
+    HAL_DELAY_CYCLES(HAL_I2C_HIGH_CYCLES);
     OCM_DATA_LOW(); // start
-
-    hali2cWait(1);
-    hali2cClock(0);
+    HAL_DELAY_CYCLES(HAL_I2C_HIGH_CYCLES);
+    OCM_CLK_LOW();
+    return I2C_SUCCESS;
 }
 
 /*********************************************************************
  * @fn      hali2cStop
- * @brief   Terminates SM-Bus communication. Waits unitl the data line
- *          is low and the clock line is high. Then sets the data line
- *          high, keeping the clock line high to stop I/O.
+ * @brief   STOP condition, SDA rises while SCL is high. Leaves both
+ *          lines released.
  * @param   void
  * @return  void
  */
 STATIC void hali2cStop(void) {
-    // Wait for clock high and data low
-    hali2cClock(0);
-    OCM_DATA_LOW(); // force low with SCL low
-    hali2cWait(1);
+    uint16 stretch = HAL_I2C_STRETCH_TIMEOUT;
 
-    hali2cClock(1);
+    OCM_CLK_LOW();
+    OCM_DATA_LOW(); // force low with SCL low
+    HAL_DELAY_CYCLES(HAL_I2C_LOW_CYCLES);
+    OCM_CLK_HIGH();
+    HAL_DELAY_CYCLES(HAL_I2C_HIGH_CYCLES);
     OCM_DATA_HIGH(); // stop condition
-    hali2cWait(1);
+    HAL_DELAY_CYCLES(HAL_I2C_LOW_CYCLES);
 
     hali2cGroudPins();
 }
 
 /*********************************************************************
- * @fn      hali2cWait
- * @brief   Wastes a an amount of time.
- * @param   count: down count in busy-wait
- * @return  void
+ * @fn      hali2cSendByte
+ * @brief   Shift one byte out MSB first and clock in the ACK. Expects
+ *          and leaves SCL low.
+ * @param   dByte - data byte to send
+ * @return  I2C_SUCCESS on ACK, I2C_ERROR on NACK, I2C_TIMEOUT
  */
-STATIC __near_func void hali2cWait(uint8 count) {
-    while (count--) {
-        asm("NOP");
+STATIC int8 hali2cSendByte(uint8 dByte) {
+    uint16 stretch = HAL_I2C_STRETCH_TIMEOUT;
+    bool nack;
+
+    HALI2C_TX_BIT(0x80);
+    HALI2C_TX_BIT(0x40);
+    HALI2C_TX_BIT(0x20);
+    HALI2C_TX_BIT(0x10);
+    HALI2C_TX_BIT(0x08);
+    HALI2C_TX_BIT(0x04);
+    HALI2C_TX_BIT(0x02);
+    HALI2C_TX_BIT(0x01);
+
+    // release SDA for the slave's ACK
+    OCM_DATA_HIGH();
+    HAL_DELAY_CYCLES(HAL_I2C_LOW_CYCLES);
+    OCM_CLK_HIGH();
+    HAL_DELAY_CYCLES(HAL_I2C_HIGH_CYCLES);
+    nack = OCM_SDA;
+    OCM_CLK_LOW();
+
+    if (!stretch) {
+        return I2C_TIMEOUT;
     }
+    return nack ? I2C_ERROR : I2C_SUCCESS;
 }
 
 /*********************************************************************
  * @fn      hali2cReceiveByte
- * @brief   Read the 8 data bits.
- * @param   void
- * @return  character read
+ * @brief   Shift one byte in MSB first and send ACK or NAK. Expects
+ *          and leaves SCL low.
+ * @param   pByte - received byte
+ * @param   ack - TRUE to ACK, FALSE to NAK the last byte
+ * @return  I2C_SUCCESS, I2C_TIMEOUT
  */
-STATIC uint8 hali2cReceiveByte() {
-    int8 i, rval = 0;
-
-    for (i = 7; i >= 0; --i) {
-        if (hali2cRead()) {
-            rval |= 1 << i;
-        }
-    }
+STATIC int8 hali2cReceiveByte(uint8 *pByte, bool ack) {
+    uint16 stretch = HAL_I2C_STRETCH_TIMEOUT;
+    uint8 dByte = 0;
 
-    return rval;
-}
-/**************************************************************************************************
-**************************************************************************************************/
-/*********************************************************************
- * @fn      hali2cReceive
- * @brief   reads data into a buffer
- * @param   address: linear address on part from which to read
- * @param   buffer: target array for read characters
- * @param   len: max number of characters to read
- * @return  void
- */
-STATIC void hali2cReceive(uint8 address, uint8 *buffer, uint16 len) {
-    // uint8  ch;
-    uint16 i;
-
-    if (!len) {
-        return;
-    }
-
-    hali2cSendDeviceAddress(address);
-
-    // ch = OCM_ADDRESS_BYTE(0, OCM_READ);
-    // hali2cSend(&ch, 1, SEND_START, NOSEND_STOP);
-
-    for (i = 0; i < len - 1; i++) {
-        // SCL may be high. set SCL low. If SDA goes high when input
-        // mode is set the slave won't see a STOP
-        hali2cClock(0);
-        OCM_DATA_HIGH();
-
-        buffer[i] = hali2cReceiveByte();
-        hali2cWrite(SMB_ACK); // write leaves SCL high
+    OCM_DATA_HIGH();
+    HALI2C_RX_BIT(0x80);
+    HALI2C_RX_BIT(0x40);
+    HALI2C_RX_BIT(0x20);
+    HALI2C_RX_BIT(0x10);
+    HALI2C_RX_BIT(0x08);
+    HALI2C_RX_BIT(0x04);
+    HALI2C_RX_BIT(0x02);
+    HALI2C_RX_BIT(0x01);
+
+    if (ack) {
+        OCM_DATA_LOW();
     }
-
-    // condition SDA one more time...
-    hali2cClock(0);
+    HAL_DELAY_CYCLES(HAL_I2C_LOW_CYCLES);
+    OCM_CLK_HIGH();
+    HAL_DELAY_CYCLES(HAL_I2C_HIGH_CYCLES);
+    OCM_CLK_LOW();
     OCM_DATA_HIGH();
-    buffer[i] = hali2cReceiveByte();
-    hali2cWrite(SMB_NAK);
-
-    hali2cStop();
-}
 
-/*********************************************************************
- * @fn      hali2cRead
- * @brief   Toggle the clock line to let the slave set the data line.
- *          Then read the data line.
- * @param   void
- * @return  TRUE if bit read is 1 else FALSE
- */
-STATIC _Bool hali2cRead(void) {
-    // SCL low to let slave set SDA. SCL high for SDA
-    // valid and then get bit
-    hali2cClock(0);
-    hali2cWait(1);
-    hali2cClock(1);
-    hali2cWait(1);
-
-    return OCM_SDA;
+    *pByte = dByte;
+    return stretch ? I2C_SUCCESS : I2C_TIMEOUT;
 }
 
 /*********************************************************************
  * @fn      hali2cSendDeviceAddress
- * @brief   Send onlythe device address. Do ack polling
- *
- * @param   void
- * @return  none
+ * @brief   START and address byte, retries while the slave NACKs
+ * @param   address - address byte including the R/W bit
+ * @return  I2C_SUCCESS, I2C_ERROR if no slave answered, I2C_TIMEOUT
  */
-STATIC void hali2cSendDeviceAddress(uint8 address) {
+STATIC int8 hali2cSendDeviceAddress(uint8 address) {
     uint8 retry = HAL_I2C_RETRY_CNT;
+    int8 status;
 
     do {
-        hali2cStart();
-        if (hali2cSendByte(address)) // do ack polling...
-        {
+        status = hali2cStart();
+        if (status == I2C_SUCCESS) {
+            status = hali2cSendByte(address);
+        }
+        if (status != I2C_ERROR) {
             break;
         }
+        hali2cStop();
     } while (--retry);
+
+    return status;
 }
 
 // http://e2e.ti.com/support/wireless-connectivity/zigbee-and-thread/f/158/t/140917
@@ -444,127 +482,41 @@ STATIC void hali2cSendDeviceAddress(uint8 address) {
  * @param   len: max number of bytes to read
  */
 int8 I2C_ReadMultByte(uint8 address, uint8 reg, uint8 *buffer, uint16 len) {
-    uint16 i = 0;
-    uint8 _address = 0;
+    halI2CSegment_t segs[2];
 
     if (!len) {
         return I2C_ERROR;
     }
-
-    /* Send START condition */
-    hali2cStart();
-
-    /* Set direction of transmission */
-    // Reset the address bit0 for write
-    // _address &= OCM_WRITE;
-
-    _address = ((address << 1) | OCM_WRITE);
-
-    /* Send Address  and get acknowledgement from slave*/
-    if (!hali2cSendByte(_address)) {
-        return I2C_ERROR;
-    }
-
-    /* Send internal register to read from to */
-    if (!hali2cSendByte(reg))
-        return I2C_ERROR;
-
-    /* Send RESTART condition */
-    hali2cStart();
-
-    /* Set direction of transmission */
-    // Reset the address bit0 for read
-    // _address |= OCM_READ;
-    _address = ((address << 1) | OCM_READ);
-    /* Send Address  and get acknowledgement from slave*/
-    if (!hali2cSendByte(_address))
-        return I2C_ERROR;
-
-    while (len) {
-        // SCL may be high. set SCL low. If SDA goes high when input
-        // mode is set the slave won't see a STOP
-        hali2cClock(0);
-        OCM_DATA_HIGH();
-        buffer[i] = hali2cReceiveByte();
-        // Acknowledgement if not sending last byte
-        if (len > 1) {
-            hali2cWrite(SMB_ACK); // write leaves SCL high
-        }
-
-        // increment buffer register
-        i++;
-        // Decrement the read bytes counter
-        len--;
-    }
-
-    // condition SDA one more time...
-    hali2cClock(0);
-    OCM_DATA_HIGH();
-    hali2cWrite(SMB_NAK);
-
-    hali2cStop();
-
-    // condition SDA one more time...
-    //   hali2cClock(0);
-    //   OCM_DATA_HIGH();
-    //   buffer[i] = hali2cReceiveByte();
-    //   hali2cWrite(SMB_NAK);
-
-    //   hali2cStop();
-    return I2C_SUCCESS;
+    segs[0].buf = &reg;
+    segs[0].len = 1;
+    segs[0].flags = 0;
+    segs[1].buf = buffer;
+    segs[1].len = len;
+    segs[1].flags = HAL_I2C_SEG_READ;
+    // register address, repeated start, data
+    return HalI2CTransfer(address, segs, 2);
 }
 
 /*********************************************************************
  * @fn      I2C_WriteMultByte
- * @brief   reads data into a buffer
- * @param   address: linear address on part from which to read
- * @param   reg: internal register address on part read from
- * @param   buffer: target array for read characters
- * @param   len: max number of bytes to read
+ * @brief   writes a buffer into consecutive registers
+ * @param   address: linear address on part to write to
+ * @param   reg: internal register address on part to write to
+ * @param   buffer: source array
+ * @param   len: number of bytes to write
  */
 int8 I2C_WriteMultByte(uint8 address, uint8 reg, uint8 *buffer, uint16 len) {
-    uint16 i = 0;
-    uint8 _address = 0;
-
-    if (!len) {
-        return I2C_ERROR;
-    }
-
-    /* Send START condition */
-    hali2cStart();
-    // return I2C_ERROR;
-
-    /* Set direction of transmission */
-    // Reset the address bit0 for write
-    // _address &= OCM_WRITE;
-    _address = ((address << 1) | OCM_WRITE);
-
-    /* Send Address  and get acknowledgement from slave*/
-    if (!hali2cSendByte(_address))
-        return I2C_ERROR;
+    halI2CSegment_t seg;
+    uint8 frame[HAL_I2C_WRITE_MAX + 1];
 
-    /* Send internal register to read from to */
-    if (!hali2cSendByte(reg))
+    if (!len || len > HAL_I2C_WRITE_MAX) {
         return I2C_ERROR;
-
-    /* Write data into register */
-    // read bytes of data into buffer
-    while (len) {
-        // SCL may be high. set SCL low. If SDA goes high when input
-        // mode is set the slave won't see a STOP
-        hali2cClock(0);
-        OCM_DATA_HIGH();
-
-        /* Send Address  and get acknowledgement from slave*/
-        if (!hali2cSendByte(buffer[i]))
-            return I2C_ERROR;
-
-        // increment buffer register
-        i++;
-        // Decrement the read bytes counter
-        len--;
     }
-
-    hali2cStop();
-    return I2C_SUCCESS;
-}
\ No newline at end of file
+    // register address and data have to follow each other without a restart
+    frame[0] = reg;
+    osal_memcpy(&frame[1], buffer, len);
+    seg.buf = frame;
+    seg.len = len + 1;
+    seg.flags = 0;
+    return HalI2CTransfer(address, &seg, 1);
+}
@@ -41,12 +41,30 @@
 #define HAL_I2C_H
 
 
+#include "hal_types.h"
+
 #define I2C_ERROR 1
 #define I2C_SUCCESS 0
+#define I2C_TIMEOUT 2 // a slave stretched the clock for too long
 
 #define OCM_READ (0x01)
 #define OCM_WRITE (0x00)
 
+/* segment flags */
+#define HAL_I2C_SEG_READ 0x01 // read into buf, default is write from buf
+#define HAL_I2C_SEG_STOP 0x02 // STOP after the segment, default is a repeated START
+
+// longest I2C_WriteMultByte payload, register address and data go out in one segment
+#ifndef HAL_I2C_WRITE_MAX
+#define HAL_I2C_WRITE_MAX 8
+#endif
+
+typedef struct {
+    uint8 *buf;
+    uint16 len;
+    uint8 flags; // HAL_I2C_SEG_*
+} halI2CSegment_t;
+
 /*********************************************************************
  * @fn      HalI2CInit
  * @brief   Initializes two-wire serial I/O bus
@@ -55,6 +73,25 @@
  */
 void  HalI2CInit( void );
 
+/*********************************************************************
+ * @fn      HalI2CAcquire
+ * @brief   Starts a bus session: pull-ups on, interrupts of the other
+ *          port inputs masked. Calls nest, every transfer
+ *          opens its own session when none is open.
+ * @param   void
+ * @return  void
+ */
+void  HalI2CAcquire( void );
+
+/*********************************************************************
+ * @fn      HalI2CRelease
+ * @brief   Ends a bus session, the last one tri-states SCL/SDA and
+ *          restores the port pull direction
+ * @param   void
+ * @return  void
+ */
+void  HalI2CRelease( void );
+
 /*********************************************************************
  * @fn      HALI2CReceive
  * @brief   Receives data into a buffer from an I2C slave device
@@ -75,7 +112,17 @@ int8   HalI2CReceive(uint8 address, uint8 *buf, uint16 len);
  */
 int8   HalI2CSend(uint8 address, uint8 *buf, uint16 len);
 
-
+/*********************************************************************
+ * @fn      HalI2CTransfer
+ * @brief   Runs a list of write/read segments as one bus session,
+ *          segments are joined by a repeated START unless
+ *          HAL_I2C_SEG_STOP is set. The bus is always stopped at the end.
+ * @param   address: 7 bit address of the slave device
+ * @param   segments: segment list
+ * @param   count: number of segments
+ * @return  I2C_SUCCESS, I2C_ERROR on NACK, I2C_TIMEOUT
+ */
+int8   HalI2CTransfer(uint8 address, const halI2CSegment_t *segments, uint8 count);
 
 int8 I2C_ReadMultByte( uint8 address, uint8 reg, uint8 *buffer, uint16 len );
 int8 I2C_WriteMultByte( uint8 address, uint8 reg, uint8 *buffer, uint16 len );
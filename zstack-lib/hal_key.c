@@ -8,6 +8,7 @@
 
 #include "hal_adc.h"
 #include "hal_defs.h"
+#include "hal_delay.h"
 #include "hal_drivers.h"
 #include "hal_led.h"
 #include "hal_mcu.h"
@@ -55,22 +56,62 @@ uint8 pinNum = 0;
 #define HAL_KEY_P1_EDGE_BITS (HAL_KEY_BIT1 | HAL_KEY_BIT2)
 #define HAL_KEY_P2_EDGE_BITS HAL_KEY_BIT3
 
+#define HAL_KEY_INPUT_GLITCH_MAX_MS 2000 // fits the uint16 sleep timer ticks
+
+// port flag to halKeyInputs index, HAL_KEY_PORT0 0x01, PORT1 0x02, PORT2 0x04
+#define HAL_KEY_INPUT_INDEX(port) ((port) >> 1)
+
 /**************************************************************************************************
  *                                            TYPEDEFS
  **************************************************************************************************/
 
+/*
+  Conditioned input, one pin per port, it owns the edge select of the port.
+  All times are sleep timer ticks, see HalDelaySleepTimer.
+*/
+typedef struct {
+    uint8 pin;        // 0 - the port sends key messages
+    uint8 mode;       // HAL_KEY_INPUT_*
+    uint8 taskId;
+    uint16 event;
+    uint16 glitch;    // edges closer than this to the previous one are bounces
+    uint32 edge;      // last edge of any kind
+    uint32 stamp;     // last accepted edge
+    uint32 count;     // HAL_KEY_INPUT_COUNT pulses since HalKeyInputTake
+    uint16 bounces;   // dropped edges since the last quiet one
+    uint16 settled;   // bounces of the last burst that is over
+    bool pressed;     // level of the last accepted edge
+    bool notify;      // HAL_KEY_INPUT_COUNT, next pulse sets the event
+    bool settling;    // HalKeyPoll checks the level once the glitch time is over
+} halKeyInput_t;
+
 /**************************************************************************************************
  *                                        GLOBAL VARIABLES
  **************************************************************************************************/
 bool Hal_KeyIntEnable;
+
+static halKeyInput_t halKeyInputs[3];
+static bool halKeyPending = FALSE; // key message waits for the debounce timer
 /**************************************************************************************************
  *                                        FUNCTIONS - Local
  **************************************************************************************************/
 void halProcessKeyInterrupt(uint8 portNum);
+static uint8 halKeyInputLevel(uint8 port, uint8 pin);
+static bool halKeyInputFollow(uint8 port, uint8 pin);
+static void halKeyInputEdge(uint8 port);
+static void halKeyInputAccept(halKeyInput_t *in, bool pressed, uint32 stamp);
+static void halKeyInputSettle(void);
 
 void HalKeyPoll(void) {
     uint8 pinStatus = 0;
     bool isPressed = false;
+
+    halKeyInputSettle();
+    // the timer may have been armed by a conditioned input only
+    if (!halKeyPending) {
+        return;
+    }
+    halKeyPending = FALSE;
     switch (portNum) {
     case HAL_KEY_PORT0:
         PICTL ^= HAL_KEY_P0_EDGE_BITS; // flip edge bit
@@ -124,16 +165,7 @@ void HalKeyConfig(bool interruptEnable, halKeyCBack_t cback) {
     P0IEN |= HAL_KEY_P0_INPUT_PINS;
     IEN1 |= HAL_KEY_BIT5;            // enable port0 int
     P0INP &= ~HAL_KEY_P0_INPUT_PINS; // Pullup/pulldown
-#if (HAL_KEY_P0_INPUT_PINS_EDGE == HAL_KEY_FALLING_EDGE)
-//    P2INP &= ~HAL_KEY_BIT5; // pull up
-//    MicroWait(50);
-//    PICTL |= HAL_KEY_P0_EDGE_BITS; // set falling edge on port
-#else
-//    P2INP |= HAL_KEY_BIT5; // pull down
-//    MicroWait(50);
-//    PICTL &= ~(HAL_KEY_P0_EDGE_BITS);
-#endif
-
+    // pull and edge of port 0 follow the level, see HalKeyInputConfig
 #endif
 
 #if HAL_KEY_P1_INPUT_PINS
@@ -170,23 +202,264 @@ void HalKeyConfig(bool interruptEnable, halKeyCBack_t cback) {
 }
 
 void halProcessKeyInterrupt(uint8 _portNum) {
+    uint8 conditioned = halKeyInputs[HAL_KEY_INPUT_INDEX(_portNum)].pin;
+
     portNum = _portNum;
     switch (_portNum) {
     case HAL_KEY_PORT0:
-        pinNum = P0IFG & HAL_KEY_P0_INPUT_PINS;
+        pinNum = P0IFG & HAL_KEY_P0_INPUT_PINS & ~conditioned;
         break;
 
     case HAL_KEY_PORT1:
-        pinNum = P1IFG & HAL_KEY_P1_INPUT_PINS;
+        pinNum = P1IFG & HAL_KEY_P1_INPUT_PINS & ~conditioned;
         break;
 
     case HAL_KEY_PORT2:
-        pinNum = P2IFG & HAL_KEY_P2_INPUT_PINS;
+        pinNum = P2IFG & HAL_KEY_P2_INPUT_PINS & ~conditioned;
+        break;
+    default:
+        break;
+    }
+    if (pinNum != 0) {
+        halKeyPending = TRUE;
+        osal_start_timerEx(Hal_TaskID, HAL_KEY_EVENT, HAL_KEY_DEBOUNCE_VALUE);
+    }
+}
+
+/*********************************************************************
+ * @fn      HalKeyInputConfig
+ * @brief   Takes a key pin over as conditioned input, pull and edge
+ *          follow its level from here on
+ * @param   port - HAL_KEY_PORT0/1/2
+ * @param   pin - one of the HAL_KEY_Px_INPUT_PINS, 0 - back to key messages
+ * @param   mode - HAL_KEY_INPUT_*
+ * @param   glitchMs - edges closer than this to the previous one are
+ *          bounces, up to HAL_KEY_INPUT_GLITCH_MAX_MS
+ * @param   taskId - task of the event
+ * @param   event - set for an accepted edge or the first pulse
+ * @return  void
+ */
+void HalKeyInputConfig(uint8 port, uint8 pin, uint8 mode, uint16 glitchMs, uint8 taskId, uint16 event) {
+    halKeyInput_t *in = &halKeyInputs[HAL_KEY_INPUT_INDEX(port)];
+    halIntState_t intState;
+
+    if (glitchMs > HAL_KEY_INPUT_GLITCH_MAX_MS) {
+        glitchMs = HAL_KEY_INPUT_GLITCH_MAX_MS;
+    }
+    HAL_ENTER_CRITICAL_SECTION(intState);
+    in->pin = pin;
+    in->mode = mode;
+    in->taskId = taskId;
+    in->event = event;
+    in->glitch = (uint16)(((uint32)glitchMs * 4096) / 125); // 32768 / 1000
+    in->stamp = HalDelaySleepTimer();
+    in->edge = (in->stamp - in->glitch) & HAL_DELAY_ST_MASK; // the first edge is a quiet one
+    in->count = 0;
+    in->bounces = 0;
+    in->settled = 0;
+    in->notify = TRUE;
+    in->settling = FALSE;
+    if (pin != 0) {
+        in->pressed = halKeyInputFollow(port, pin);
+    }
+    HAL_EXIT_CRITICAL_SECTION(intState);
+}
+
+/*********************************************************************
+ * @fn      HalKeyInputRead
+ * @brief   Last accepted edge of a conditioned input
+ * @param   port - HAL_KEY_PORT0/1/2
+ * @param   stamp - HalDelaySleepTimer at the edge, may be NULL
+ * @param   bounces - edges dropped by the glitch filter in the last
+ *          burst that is over, may be NULL
+ * @return  TRUE if the pin is at the HAL_KEY_Px_INPUT_PINS_EDGE level
+ */
+bool HalKeyInputRead(uint8 port, uint32 *stamp, uint16 *bounces) {
+    halKeyInput_t *in = &halKeyInputs[HAL_KEY_INPUT_INDEX(port)];
+    halIntState_t intState;
+    bool pressed;
+
+    HAL_ENTER_CRITICAL_SECTION(intState);
+    pressed = in->pressed;
+    if (stamp != NULL) {
+        *stamp = in->stamp;
+    }
+    if (bounces != NULL) {
+        *bounces = in->settled;
+    }
+    HAL_EXIT_CRITICAL_SECTION(intState);
+    return pressed;
+}
+
+/*********************************************************************
+ * @fn      HalKeyInputTake
+ * @brief   Pulses of a HAL_KEY_INPUT_COUNT input, the event is set
+ *          again for the next pulse if there were none
+ * @param   port - HAL_KEY_PORT0/1/2
+ * @return  pulses since the last call
+ */
+uint32 HalKeyInputTake(uint8 port) {
+    halKeyInput_t *in = &halKeyInputs[HAL_KEY_INPUT_INDEX(port)];
+    halIntState_t intState;
+    uint32 count;
+
+    HAL_ENTER_CRITICAL_SECTION(intState);
+    count = in->count;
+    in->count = 0;
+    in->notify = (count == 0);
+    HAL_EXIT_CRITICAL_SECTION(intState);
+    return count;
+}
+
+static uint8 halKeyInputLevel(uint8 port, uint8 pin) {
+    switch (port) {
+    case HAL_KEY_PORT0:
+        return P0 & pin;
+    case HAL_KEY_PORT1:
+        return P1 & pin;
+    default:
+        return P2 & pin;
+    }
+}
+
+/*********************************************************************
+ * @fn      halKeyInputFollow
+ * @brief   Pulls the pin the way it already is and selects the edge
+ *          back, a level change in between is caught by the re-read
+ * @return  TRUE if the pin is at the pressed level
+ */
+static bool halKeyInputFollow(uint8 port, uint8 pin) {
+    uint8 pud, edge, pressedLevel, again;
+    uint8 level = halKeyInputLevel(port, pin);
+    uint8 tries = 3;
+
+    switch (port) {
+    case HAL_KEY_PORT0:
+        pud = HAL_KEY_BIT5;
+        edge = HAL_KEY_P0_EDGE_BITS;
+        pressedLevel = HAL_KEY_P0_INPUT_PINS_EDGE == HAL_KEY_RISING_EDGE;
+        break;
+    case HAL_KEY_PORT1:
+        pud = HAL_KEY_BIT6;
+        edge = HAL_KEY_P1_EDGE_BITS;
+        pressedLevel = HAL_KEY_P1_INPUT_PINS_EDGE == HAL_KEY_RISING_EDGE;
         break;
     default:
+        pud = HAL_KEY_BIT7;
+        edge = HAL_KEY_P2_EDGE_BITS;
+        pressedLevel = HAL_KEY_P2_INPUT_PINS_EDGE == HAL_KEY_RISING_EDGE;
         break;
     }
-    osal_start_timerEx(Hal_TaskID, HAL_KEY_EVENT, HAL_KEY_DEBOUNCE_VALUE);
+    for (;;) {
+        if (level) {
+            P2INP &= ~pud;  // pull up
+            PICTL |= edge;  // falling edge
+        } else {
+            P2INP |= pud;   // pull down
+            PICTL &= ~edge; // rising edge
+        }
+        again = halKeyInputLevel(port, pin);
+        if (again == level || --tries == 0) {
+            break;
+        }
+        level = again;
+    }
+    return pressedLevel == (level != 0);
+}
+
+/*********************************************************************
+ * @fn      halKeyInputEdge
+ * @brief   Port ISR part of a conditioned input, the pin flag has to
+ *          be cleared before
+ */
+static void halKeyInputEdge(uint8 port) {
+    halKeyInput_t *in = &halKeyInputs[HAL_KEY_INPUT_INDEX(port)];
+    uint32 now = HalDelaySleepTimer();
+    bool quiet = ((now - in->edge) & HAL_DELAY_ST_MASK) >= in->glitch;
+    bool pressed = halKeyInputFollow(port, in->pin);
+
+    in->edge = now;
+    if (quiet) {
+        // a quiet edge starts the next burst, the previous one is over
+        in->settled = in->bounces;
+        in->bounces = 0;
+    } else if (in->bounces != 0xFFFF) {
+        in->bounces++;
+    }
+
+    if (in->mode & HAL_KEY_INPUT_COUNT) {
+        // the pulse starts with the pressing edge, the release is no event
+        if (quiet && pressed) {
+            in->stamp = now;
+            in->count++;
+            if (in->notify) {
+                in->notify = FALSE;
+                osal_set_event(in->taskId, in->event);
+            }
+        }
+        return;
+    }
+
+    if (quiet && (in->mode & HAL_KEY_INPUT_FIRST_EDGE)) {
+        if (pressed != in->pressed) {
+            halKeyInputAccept(in, pressed, now);
+        }
+        return;
+    }
+    // one timer per burst, not per bounce
+    if (!in->settling) {
+        in->settling = TRUE;
+        osal_start_timerEx(Hal_TaskID, HAL_KEY_EVENT, ((uint32)in->glitch * 125) / 4096 + 1);
+    }
+}
+
+static void halKeyInputAccept(halKeyInput_t *in, bool pressed, uint32 stamp) {
+    in->pressed = pressed;
+    in->stamp = stamp;
+    osal_set_event(in->taskId, in->event);
+}
+
+/*********************************************************************
+ * @fn      halKeyInputSettle
+ * @brief   Bursts that are over take the level the pin settled at,
+ *          running ones re-arm the key timer for the rest
+ */
+static void halKeyInputSettle(void) {
+    halIntState_t intState;
+    uint16 rest = 0;
+    uint8 i;
+
+    for (i = 0; i < sizeof(halKeyInputs) / sizeof(halKeyInputs[0]); i++) {
+        halKeyInput_t *in = &halKeyInputs[i];
+        bool settled = FALSE;
+        uint32 since;
+
+        HAL_ENTER_CRITICAL_SECTION(intState);
+        if (in->settling) {
+            since = (HalDelaySleepTimer() - in->edge) & HAL_DELAY_ST_MASK;
+            if (since < in->glitch) {
+                uint16 left = (uint16)(((in->glitch - since) * 125) / 4096 + 1);
+                if (rest == 0 || left < rest) {
+                    rest = left;
+                }
+            } else {
+                bool pressed = halKeyInputFollow(BV(i), in->pin);
+                in->settling = FALSE;
+                in->settled = in->bounces;
+                settled = TRUE;
+                if (pressed != in->pressed) {
+                    halKeyInputAccept(in, pressed, in->edge);
+                }
+            }
+        }
+        HAL_EXIT_CRITICAL_SECTION(intState);
+        if (settled) {
+            LREP("input port=0x%X pressed=%d bounces=%d\r\n", BV(i), in->pressed, in->bounces);
+        }
+    }
+    if (rest != 0) {
+        osal_start_timerEx(Hal_TaskID, HAL_KEY_EVENT, rest);
+    }
 }
 
 void HalKeyEnterSleep(void) {
@@ -221,11 +494,16 @@ uint8 HalKeyExitSleep(void) {
 HAL_ISR_FUNCTION(halKeyPort0Isr, P0INT_VECTOR) {
     HAL_ENTER_ISR();
 
-    if (P0IFG & HAL_KEY_P0_INPUT_PINS) {
+    if (P0IFG & halKeyInputs[0].pin) {
+        // cleared before the level is read, an edge from here on raises it again
+        P0IFG = ~halKeyInputs[0].pin;
+        halKeyInputEdge(HAL_KEY_PORT0);
+    }
+    if (P0IFG & HAL_KEY_P0_INPUT_PINS & ~halKeyInputs[0].pin) {
         halProcessKeyInterrupt(HAL_KEY_PORT0);
     }
 
-    P0IFG = 0; //&= ~HAL_KEY_P0_INPUT_PINS;
+    P0IFG = ~(HAL_KEY_P0_INPUT_PINS & ~halKeyInputs[0].pin);
     P0IF = 0;
 
     CLEAR_SLEEP_MODE();
@@ -237,11 +515,15 @@ HAL_ISR_FUNCTION(halKeyPort0Isr, P0INT_VECTOR) {
 HAL_ISR_FUNCTION(halKeyPort1Isr, P1INT_VECTOR) {
     HAL_ENTER_ISR();
 
-    if (P1IFG & HAL_KEY_P1_INPUT_PINS) {
+    if (P1IFG & halKeyInputs[1].pin) {
+        P1IFG = ~halKeyInputs[1].pin;
+        halKeyInputEdge(HAL_KEY_PORT1);
+    }
+    if (P1IFG & HAL_KEY_P1_INPUT_PINS & ~halKeyInputs[1].pin) {
         halProcessKeyInterrupt(HAL_KEY_PORT1);
     }
 
-    P1IFG = 0; //&= ~HAL_KEY_P1_INPUT_PINS;
+    P1IFG = ~(HAL_KEY_P1_INPUT_PINS & ~halKeyInputs[1].pin);
     P1IF = 0;
 
     CLEAR_SLEEP_MODE();
@@ -253,11 +535,15 @@ HAL_ISR_FUNCTION(halKeyPort1Isr, P1INT_VECTOR) {
 HAL_ISR_FUNCTION(halKeyPort2Isr, P2INT_VECTOR) {
     HAL_ENTER_ISR();
 
-    if (P2IFG & HAL_KEY_P2_INPUT_PINS) {
+    if (P2IFG & halKeyInputs[2].pin) {
+        P2IFG = ~halKeyInputs[2].pin;
+        halKeyInputEdge(HAL_KEY_PORT2);
+    }
+    if (P2IFG & HAL_KEY_P2_INPUT_PINS & ~halKeyInputs[2].pin) {
         halProcessKeyInterrupt(HAL_KEY_PORT2);
     }
 
-    P2IFG = 0; //&= ~HAL_KEY_P2_INPUT_PINS;
+    P2IFG = ~(HAL_KEY_P2_INPUT_PINS & ~halKeyInputs[2].pin);
     P2IF = 0;
 
     CLEAR_SLEEP_MODE();
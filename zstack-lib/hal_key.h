@@ -90,6 +90,11 @@ extern "C"
 #define HAL_KEY_PRESS 0x20
 #define HAL_KEY_RELEASE 0x40
 
+/* Conditioned input modes, see HalKeyInputConfig */
+#define HAL_KEY_INPUT_STABLE     0x00 // event once the level stayed for the glitch time
+#define HAL_KEY_INPUT_FIRST_EDGE 0x01 // event on the first edge after a quiet glitch time, the level is checked once the bounces are over
+#define HAL_KEY_INPUT_COUNT      0x02 // count pressing edges, event for the first one after HalKeyInputTake found none
+
 
 
 #define HAL_KEY_SW_1 0x01  // Joystick up
@@ -145,6 +150,25 @@ extern uint8 HalKeyExitSleep ( void );
  */
 extern void HalKeyPoll ( void );
 
+/*
+ * Conditioned input on a key pin, edges go to the task as an OSAL event
+ * instead of key messages. Pull and edge select follow the level, edges
+ * within glitchMs of the previous one are counted as bounces, times are
+ * taken with the sleep timer, so nothing runs per bounce but the ISR.
+ */
+extern void HalKeyInputConfig( uint8 port, uint8 pin, uint8 mode, uint16 glitchMs, uint8 taskId, uint16 event );
+
+/*
+ * Level and sleep timer stamp of the last accepted edge, bounces of the
+ * last burst that is over
+ */
+extern bool HalKeyInputRead( uint8 port, uint32 *stamp, uint16 *bounces );
+
+/*
+ * Pulses of a HAL_KEY_INPUT_COUNT input since the last call
+ */
+extern uint32 HalKeyInputTake( uint8 port );
+
 /*
  * This is for internal used by hal_sleep
  */
@@ -0,0 +1,144 @@
+#include "hal_spi_dma.h"
+
+#include "hal_board.h"
+#include "hal_delay.h"
+#include "hal_dma.h"
+#include "hal_mcu.h"
+#include "ioCC2530.h"
+
+// the default cofiguration below uses DMA channels 1 and 2,
+// channel 0 belongs to NV, 3 and 4 to the UART.
+#ifndef HAL_SPI_DMA_CH_RX
+#define HAL_SPI_DMA_CH_RX 1
+#endif
+
+#ifndef HAL_SPI_DMA_CH_TX
+#define HAL_SPI_DMA_CH_TX 2
+#endif
+
+#define HAL_SPI_DMA_U1DBUF 0x70F9 // U1DBUF as seen from XDATA space
+
+#define HAL_SPI_DMA_PINS (BV(5) | BV(6) | BV(7)) // P1.5 CLK, P1.6 MOSI, P1.7 MISO
+
+#define HAL_SPI_DMA_RX_ARMED() (DMAARM & BV(HAL_SPI_DMA_CH_RX))
+
+static halSpiDmaXfer_t *halSpiDmaActive = NULL;
+static const halSpiDmaDevice_t *halSpiDmaDevice = NULL; // owner of the current clock setting
+static uint8 halSpiDmaZero = 0;                         // tx source when xfer->tx is NULL
+static uint8 halSpiDmaSink;                             // rx target when xfer->rx is NULL
+
+void HalSpiDmaInit(void) {
+  /* Set SPI on UART 1 alternative 2 */
+  PERCFG |= 0x02;
+  P1SEL |= HAL_SPI_DMA_PINS;
+
+  U1UCR = 0x00; /* Flush and goto IDLE state. 8-N-1. */
+  U1CSR = 0x00; /* SPI mode, master. */
+
+  halSpiDmaActive = NULL;
+  halSpiDmaDevice = NULL; // first transfer loads the device clock
+
+  DMAIE = 1; // DMA interrupt wakes the CPU in HalSpiDmaWait
+}
+
+void HalSpiDmaRelease(void) {
+  PERCFG &= ~0x02;
+  P1SEL &= ~HAL_SPI_DMA_PINS;
+  halSpiDmaDevice = NULL;
+}
+
+uint8 HalSpiDmaTransfer(const halSpiDmaDevice_t *dev, halSpiDmaXfer_t *xfer) {
+  halDMADesc_t *ch;
+
+  if (halSpiDmaActive != NULL) {
+    return HAL_SPI_DMA_BUSY;
+  }
+  halSpiDmaActive = xfer;
+
+  if (halSpiDmaDevice != dev) {
+    U1GCR = dev->mode | dev->baudE;
+    U1BAUD = dev->baudM;
+    halSpiDmaDevice = dev;
+  }
+  dev->chipSelect(TRUE);
+
+  // rx has the higher priority so U1DBUF is read before tx writes the next byte
+  ch = HAL_DMA_GET_DESC1234(HAL_SPI_DMA_CH_RX);
+  HAL_DMA_SET_SOURCE(ch, HAL_SPI_DMA_U1DBUF);
+  if (xfer->rx != NULL) {
+    HAL_DMA_SET_DEST(ch, xfer->rx);
+    HAL_DMA_SET_DST_INC(ch, HAL_DMA_DSTINC_1);
+  } else {
+    HAL_DMA_SET_DEST(ch, &halSpiDmaSink);
+    HAL_DMA_SET_DST_INC(ch, HAL_DMA_DSTINC_0);
+  }
+  HAL_DMA_SET_VLEN(ch, HAL_DMA_VLEN_USE_LEN);
+  HAL_DMA_SET_LEN(ch, xfer->len);
+  HAL_DMA_SET_WORD_SIZE(ch, HAL_DMA_WORDSIZE_BYTE);
+  HAL_DMA_SET_TRIG_MODE(ch, HAL_DMA_TMODE_SINGLE);
+  HAL_DMA_SET_TRIG_SRC(ch, HAL_DMA_TRIG_URX1);
+  HAL_DMA_SET_SRC_INC(ch, HAL_DMA_SRCINC_0);
+  HAL_DMA_SET_IRQ(ch, HAL_DMA_IRQMASK_ENABLE);
+  HAL_DMA_SET_M8(ch, HAL_DMA_M8_USE_8_BITS);
+  HAL_DMA_SET_PRIORITY(ch, HAL_DMA_PRI_HIGH);
+
+  ch = HAL_DMA_GET_DESC1234(HAL_SPI_DMA_CH_TX);
+  if (xfer->tx != NULL) {
+    HAL_DMA_SET_SOURCE(ch, xfer->tx);
+    HAL_DMA_SET_SRC_INC(ch, HAL_DMA_SRCINC_1);
+  } else {
+    HAL_DMA_SET_SOURCE(ch, &halSpiDmaZero);
+    HAL_DMA_SET_SRC_INC(ch, HAL_DMA_SRCINC_0);
+  }
+  HAL_DMA_SET_DEST(ch, HAL_SPI_DMA_U1DBUF);
+  HAL_DMA_SET_VLEN(ch, HAL_DMA_VLEN_USE_LEN);
+  HAL_DMA_SET_LEN(ch, xfer->len);
+  HAL_DMA_SET_WORD_SIZE(ch, HAL_DMA_WORDSIZE_BYTE);
+  HAL_DMA_SET_TRIG_MODE(ch, HAL_DMA_TMODE_SINGLE);
+  HAL_DMA_SET_TRIG_SRC(ch, HAL_DMA_TRIG_UTX1);
+  HAL_DMA_SET_DST_INC(ch, HAL_DMA_DSTINC_0);
+  HAL_DMA_SET_IRQ(ch, HAL_DMA_IRQMASK_DISABLE);
+  HAL_DMA_SET_M8(ch, HAL_DMA_M8_USE_8_BITS);
+  HAL_DMA_SET_PRIORITY(ch, HAL_DMA_PRI_GUARANTEED);
+
+  HAL_DMA_CLEAR_IRQ(HAL_SPI_DMA_CH_RX);
+  U1CSR &= ~(BV(2) | BV(1)); // clear the received and transmit byte status
+
+  HAL_DMA_ARM_CH(HAL_SPI_DMA_CH_RX);
+  HAL_DMA_ARM_CH(HAL_SPI_DMA_CH_TX);
+  HAL_DELAY_DMA_ARM();
+  // first byte by hand, UTX1 triggers the rest
+  HAL_DMA_MAN_TRIGGER(HAL_SPI_DMA_CH_TX);
+
+  return HAL_SPI_DMA_SUCCESS;
+}
+
+bool HalSpiDmaPoll(void) {
+  halSpiDmaXfer_t *xfer = halSpiDmaActive;
+
+  if (xfer == NULL) {
+    return TRUE;
+  }
+  // rx is disarmed once the last byte has been clocked in
+  if (HAL_SPI_DMA_RX_ARMED()) {
+    return FALSE;
+  }
+  HAL_DMA_CLEAR_IRQ(HAL_SPI_DMA_CH_RX);
+
+  if (!(xfer->flags & HAL_SPI_DMA_HOLD_CS)) {
+    halSpiDmaDevice->chipSelect(FALSE);
+  }
+  halSpiDmaActive = NULL;
+  if (xfer->done != NULL) {
+    xfer->done(xfer);
+  }
+  return TRUE;
+}
+
+void HalSpiDmaWait(void) {
+  // a done callback may start the next transfer
+  while (!HalSpiDmaPoll()) {
+    // idle until the DMA (or any other) interrupt
+    HAL_DELAY_IDLE_WHILE(HAL_SPI_DMA_RX_ARMED());
+  }
+}
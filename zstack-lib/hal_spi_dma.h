@@ -0,0 +1,94 @@
+#ifndef HAL_SPI_DMA_H
+#define HAL_SPI_DMA_H
+
+#include "hal_types.h"
+
+/*
+  DMA driven SPI master on USART1 alternative 2
+
+  P1.5 - CLK
+  P1.6 - MOSI
+  P1.7 - MISO
+
+  Chip select stays with the device driver, every device brings its own
+  clock setting, so several devices can share the bus.
+*/
+
+#define HAL_SPI_DMA_SUCCESS 0
+#define HAL_SPI_DMA_BUSY    1
+
+/* USART GCR bits */
+#define HAL_SPI_DMA_CPOL_LO       0x00 // CPOL 0 0x00, CPOL 1 0x80
+#define HAL_SPI_DMA_CPOL_HI       0x80
+#define HAL_SPI_DMA_CPHA_0        0x00 // CPHA 0 0x00, CPHA 1 0x40
+#define HAL_SPI_DMA_CPHA_1        0x40
+#define HAL_SPI_DMA_MSB_FIRST     0x20 // ORDER 0 0x00 LSB first, ORDER 1 0x20 MSB first
+
+/*
+  SCK = (256 + BAUD_M) * 2^BAUD_E / 2^28 * 32 MHz, USART master can't go above F/8
+*/
+#define HAL_SPI_DMA_BAUD_E_1MHZ 15
+#define HAL_SPI_DMA_BAUD_E_2MHZ 16
+#define HAL_SPI_DMA_BAUD_E_4MHZ 17
+
+/* transfer flags */
+#define HAL_SPI_DMA_HOLD_CS 0x01 // keep chip select asserted, the next transfer continues the frame
+
+typedef struct {
+  uint8 baudE;                        // HAL_SPI_DMA_BAUD_E_*
+  uint8 baudM;
+  uint8 mode;                         // HAL_SPI_DMA_CPOL_* | HAL_SPI_DMA_CPHA_* | HAL_SPI_DMA_MSB_FIRST
+  void (*chipSelect)(uint8 select);   // TRUE - assert, FALSE - release
+} halSpiDmaDevice_t;
+
+typedef struct halSpiDmaXfer_s {
+  const uint8 *tx;                    // NULL - clock out zeros
+  uint8 *rx;                          // NULL - discard received bytes
+  uint16 len;
+  uint8 flags;                        // HAL_SPI_DMA_HOLD_CS
+  void (*done)(struct halSpiDmaXfer_s *xfer); // called from HalSpiDmaPoll, may be NULL
+} halSpiDmaXfer_t;
+
+/*********************************************************************
+ * @fn      HalSpiDmaInit
+ * @brief   Routes USART1 alt2 to P1.5-P1.7 and configures SPI master
+ * @param   void
+ * @return  void
+ */
+extern void HalSpiDmaInit(void);
+
+/*********************************************************************
+ * @fn      HalSpiDmaRelease
+ * @brief   Returns the bus pins to GPIO, e.g. when no device answered
+ * @param   void
+ * @return  void
+ */
+extern void HalSpiDmaRelease(void);
+
+/*********************************************************************
+ * @fn      HalSpiDmaTransfer
+ * @brief   Asserts chip select and starts a full duplex DMA transfer
+ * @param   dev - device the transfer is addressed to
+ * @param   xfer - descriptor, must stay valid until the transfer is done
+ * @return  HAL_SPI_DMA_BUSY if another transfer is in progress
+ */
+extern uint8 HalSpiDmaTransfer(const halSpiDmaDevice_t *dev, halSpiDmaXfer_t *xfer);
+
+/*********************************************************************
+ * @fn      HalSpiDmaPoll
+ * @brief   Completes a finished transfer, releases chip select and
+ *          calls the completion callback
+ * @param   void
+ * @return  TRUE if the bus is idle
+ */
+extern bool HalSpiDmaPoll(void);
+
+/*********************************************************************
+ * @fn      HalSpiDmaWait
+ * @brief   Idles the CPU until the current transfer is completed
+ * @param   void
+ * @return  void
+ */
+extern void HalSpiDmaWait(void);
+
+#endif
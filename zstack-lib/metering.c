@@ -0,0 +1,150 @@
+#include "metering.h"
+
+#include "Debug.h"
+#include "OSAL.h"
+#include "OSAL_Nv.h"
+#include "OSAL_Timers.h"
+#include "bdb_interface.h"
+#include "zcl.h"
+
+#define ZCL_METERING_DEMAND_MAX 0x7FFFFFL // int24
+
+static uint8 zclMetering_Endpoint;
+static uint16 zclMetering_NvId;
+static bool zclMetering_Flowing = FALSE; // last batch brought pulses
+static uint32 zclMetering_BatchStart = 0; // osal_GetSystemClock ms
+static uint32 zclMetering_Unsaved = 0;   // pulses since the last NV write
+static uint32 zclMetering_SavedAt = 0;
+
+uint8 zclMetering_Summation[6] = {0, 0, 0, 0, 0, 0};
+int32 zclMetering_Demand = 0;
+uint8 zclMetering_Status = 0;
+
+static void zclMetering_Add(uint32 pulses);
+static void zclMetering_Commit(uint32 now);
+
+/*********************************************************************
+ * @fn      zclMetering_Init
+ * @brief   Restores the summation from NV
+ * @param   endpoint - of the metering cluster
+ * @param   nvId - NV item of the summation
+ * @return  void
+ */
+void zclMetering_Init(uint8 endpoint, uint16 nvId) {
+    uint8 status;
+
+    zclMetering_Endpoint = endpoint;
+    zclMetering_NvId = nvId;
+    status = osal_nv_item_init(nvId, sizeof(zclMetering_Summation), zclMetering_Summation);
+    if (status == ZSUCCESS) {
+        osal_nv_read(nvId, 0, sizeof(zclMetering_Summation), zclMetering_Summation);
+    }
+    zclMetering_SavedAt = osal_GetSystemClock();
+    zclMetering_BatchStart = zclMetering_SavedAt;
+    LREP("zclMetering_Init status=%d\r\n", status);
+}
+
+/*********************************************************************
+ * @fn      zclMetering_Process
+ * @brief   Takes over a batch of pulses, reports once per batch
+ * @param   pulses - counted since the last call
+ * @return  ms until the next batch, 0 - standing still, the next pulse
+ *          has to start a batch
+ */
+uint32 zclMetering_Process(uint32 pulses) {
+    uint32 now = osal_GetSystemClock();
+    uint32 elapsed = (now - zclMetering_BatchStart) / 100; // 1/10 s
+
+    zclMetering_Add(pulses);
+    if (pulses == 0) {
+        zclMetering_Demand = 0;
+    } else if (zclMetering_Flowing && elapsed != 0) {
+        // pulses * 36000 stays in 32 bits up to 119304 pulses per batch
+        uint32 demand = pulses * 36000 / elapsed;
+        zclMetering_Demand = demand < ZCL_METERING_DEMAND_MAX ? (int32)demand : ZCL_METERING_DEMAND_MAX;
+    }
+    // first pulses after standing still report the summation, the next batch the rate
+    if (pulses != 0 || zclMetering_Flowing) {
+        zclMetering_Report();
+    }
+    zclMetering_Flowing = pulses != 0;
+    zclMetering_BatchStart = now;
+    zclMetering_Commit(now);
+
+    LREP("zclMetering_Process pulses=%ld demand=%ld\r\n", pulses, zclMetering_Demand);
+    return zclMetering_Flowing ? ZCL_METERING_REPORT_MIN_MS : 0;
+}
+
+/*********************************************************************
+ * @fn      zclMetering_Report
+ * @brief   Sends summation and demand to the bindings, also a chance
+ *          to save pulses that came in long ago
+ * @param   void
+ * @return  void
+ */
+void zclMetering_Report(void) {
+    afAddrType_t inderect_DstAddr = {.addrMode = (afAddrMode_t)AddrNotPresent, .endPoint = 0, .addr.shortAddr = 0};
+    const uint8 NUM_ATTRIBUTES = 2;
+    zclReportCmd_t *pReportCmd;
+
+    pReportCmd = osal_mem_alloc(sizeof(zclReportCmd_t) + (NUM_ATTRIBUTES * sizeof(zclReport_t)));
+    if (pReportCmd != NULL) {
+        pReportCmd->numAttr = NUM_ATTRIBUTES;
+
+        pReportCmd->attrList[0].attrID = ZCL_METERING_ATTRID_CURRENT_SUMMATION_DELIVERED;
+        pReportCmd->attrList[0].dataType = ZCL_DATATYPE_UINT48;
+        pReportCmd->attrList[0].attrData = (void *)zclMetering_Summation;
+
+        pReportCmd->attrList[1].attrID = ZCL_METERING_ATTRID_INSTANTANEOUS_DEMAND;
+        pReportCmd->attrList[1].dataType = ZCL_DATATYPE_INT24;
+        pReportCmd->attrList[1].attrData = (void *)&zclMetering_Demand;
+
+        zcl_SendReportCmd(zclMetering_Endpoint, &inderect_DstAddr, ZCL_METERING_CLUSTER_ID, pReportCmd,
+                          ZCL_FRAME_SERVER_CLIENT_DIR, TRUE, bdb_getZCLFrameCounter());
+        osal_mem_free(pReportCmd);
+    }
+    zclMetering_Commit(osal_GetSystemClock());
+}
+
+/*********************************************************************
+ * @fn      zclMetering_Save
+ * @brief   Writes the summation to NV right away, e.g. after the
+ *          attribute has been set to the meter reading
+ * @param   void
+ * @return  void
+ */
+void zclMetering_Save(void) {
+    uint8 status = osal_nv_write(zclMetering_NvId, 0, sizeof(zclMetering_Summation), zclMetering_Summation);
+    LREP("zclMetering_Save unsaved=%ld status=%d\r\n", zclMetering_Unsaved, status);
+    zclMetering_Unsaved = 0;
+    zclMetering_SavedAt = osal_GetSystemClock();
+}
+
+static void zclMetering_Add(uint32 pulses) {
+    uint8 i;
+
+    zclMetering_Unsaved += pulses;
+    // 48 bit little endian, byte by byte with carry
+    for (i = 0; i < sizeof(zclMetering_Summation) && pulses != 0; i++) {
+        pulses += zclMetering_Summation[i];
+        zclMetering_Summation[i] = (uint8)pulses;
+        pulses >>= 8;
+    }
+}
+
+/*********************************************************************
+ * @fn      zclMetering_Commit
+ * @brief   NV writes in batches, enough pulses but not more often than
+ *          ZCL_METERING_NV_MIN_MS, a few pulses after ZCL_METERING_NV_MAX_MS
+ */
+static void zclMetering_Commit(uint32 now) {
+    uint32 since = now - zclMetering_SavedAt;
+
+    if (zclMetering_Unsaved == 0) {
+        return;
+    }
+    if ((zclMetering_Unsaved >= ZCL_METERING_NV_PULSES && since >= ZCL_METERING_NV_MIN_MS) ||
+        since >= ZCL_METERING_NV_MAX_MS) {
+        zclMetering_Save();
+    }
+}
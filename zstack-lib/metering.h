@@ -0,0 +1,59 @@
+#ifndef METERING_H
+#define METERING_H
+
+#include "hal_types.h"
+
+/*
+  Simple Metering server for a pulse output (reed or open collector) of
+  a gas or water meter. The pulses are counted by the port interrupt,
+  zclMetering_Process takes them over in batches.
+
+  CurrentSummationDelivered counts pulses, Multiplier and Divisor turn
+  them into the UnitOfMeasure. InstantaneousDemand is the pulse rate per
+  hour over the last batch, 0 once a batch brings no pulses.
+
+  The summation goes to NV in batches, at most every ZCL_METERING_NV_MIN_MS,
+  a reset loses the pulses of the last batch at worst.
+*/
+
+#define ZCL_METERING_CLUSTER_ID 0x0702 // Smart Energy Metering, not in the HA build of the stack
+
+#define ZCL_METERING_ATTRID_CURRENT_SUMMATION_DELIVERED 0x0000
+#define ZCL_METERING_ATTRID_STATUS                      0x0200
+#define ZCL_METERING_ATTRID_UNIT_OF_MEASURE             0x0300
+#define ZCL_METERING_ATTRID_MULTIPLIER                  0x0301
+#define ZCL_METERING_ATTRID_DIVISOR                     0x0302
+#define ZCL_METERING_ATTRID_SUMMATION_FORMATTING        0x0303
+#define ZCL_METERING_ATTRID_DEVICE_TYPE                 0x0306
+#define ZCL_METERING_ATTRID_INSTANTANEOUS_DEMAND        0x0400
+
+#define ZCL_METERING_UNIT_M3        0x01
+#define ZCL_METERING_DEVICE_GAS     0x01
+#define ZCL_METERING_DEVICE_WATER   0x02
+
+#ifndef ZCL_METERING_REPORT_MIN_MS
+#define ZCL_METERING_REPORT_MIN_MS ((uint32)30000) // batch length while pulses come in
+#endif
+
+#ifndef ZCL_METERING_NV_PULSES
+#define ZCL_METERING_NV_PULSES 100 // unsaved pulses that are worth a NV write
+#endif
+
+#ifndef ZCL_METERING_NV_MIN_MS
+#define ZCL_METERING_NV_MIN_MS ((uint32)900000) // 15 minutes between NV writes
+#endif
+
+#ifndef ZCL_METERING_NV_MAX_MS
+#define ZCL_METERING_NV_MAX_MS ((uint32)21600000) // 6 hours at most for a few unsaved pulses
+#endif
+
+extern uint8 zclMetering_Summation[6]; // uint48, little endian as the ZCL attribute
+extern int32 zclMetering_Demand;       // int24, pulses per hour
+extern uint8 zclMetering_Status;
+
+extern void zclMetering_Init(uint8 endpoint, uint16 nvId);
+extern uint32 zclMetering_Process(uint32 pulses);
+extern void zclMetering_Report(void);
+extern void zclMetering_Save(void);
+
+#endif
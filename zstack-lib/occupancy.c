@@ -0,0 +1,214 @@
+#include "occupancy.h"
+
+#include "Debug.h"
+#include "OSAL.h"
+#include "OSAL_Timers.h"
+
+static const zclOccupancy_t *zclOccupancy_Config = NULL;
+static uint8 zclOccupancy_TaskId;
+static uint16 zclOccupancy_Event;
+
+static uint32 zclOccupancy_HoldEnd = 0;   // osal_GetSystemClock ms
+static uint8 zclOccupancy_Triggers = 0;   // motion edges while TRIGGERING
+static bool zclOccupancy_Motion = FALSE;  // PIR output after the last edge
+static bool zclOccupancy_Settled = FALSE; // COOLDOWN settle time is over
+
+uint8 zclOccupancy_State = ZCL_OCCUPANCY_COOLDOWN;
+
+static void zclOccupancy_Enter(uint8 state, uint32 ms);
+static void zclOccupancy_Trigger(void);
+static void zclOccupancy_Hold(void);
+static void zclOccupancy_CooldownDone(void);
+static void zclOccupancy_Report(uint8 occupied);
+static uint32 zclOccupancy_HoldLeft(void);
+
+/*********************************************************************
+ * @fn      zclOccupancy_Init
+ * @brief   Starts in COOLDOWN, the PIR has just been powered with the board
+ * @param   config - attributes and callbacks, must stay valid
+ * @param   taskId - task of the state timer
+ * @param   event - state timer, calls zclOccupancy_Process when it fires
+ * @return  void
+ */
+void zclOccupancy_Init(const zclOccupancy_t *config, uint8 taskId, uint16 event) {
+    zclOccupancy_Config = config;
+    zclOccupancy_TaskId = taskId;
+    zclOccupancy_Event = event;
+    zclOccupancy_Motion = FALSE;
+    zclOccupancy_Settled = FALSE;
+
+    if (config->sensorPower != NULL) {
+        config->sensorPower(TRUE);
+    }
+    zclOccupancy_Enter(ZCL_OCCUPANCY_COOLDOWN, ZCL_OCCUPANCY_SETTLE_MS);
+}
+
+/*********************************************************************
+ * @fn      zclOccupancy_Edge
+ * @brief   Feeds a PIR output edge into the state machine
+ * @param   motion - PIR output after the edge
+ * @return  void
+ */
+void zclOccupancy_Edge(bool motion) {
+    zclOccupancy_Motion = motion;
+
+    switch (zclOccupancy_State) {
+    case ZCL_OCCUPANCY_UNOCCUPIED:
+        if (motion) {
+            zclOccupancy_Triggers = 0;
+            zclOccupancy_Trigger();
+        }
+        break;
+
+    case ZCL_OCCUPANCY_TRIGGERING:
+        if (motion) {
+            zclOccupancy_Trigger();
+        }
+        break;
+
+    case ZCL_OCCUPANCY_OCCUPIED:
+        // still there, nothing to report
+        if (motion) {
+            zclOccupancy_Hold();
+            if (zclOccupancy_Config->rearm != NULL) {
+                zclOccupancy_Config->rearm();
+            }
+        }
+        break;
+
+    case ZCL_OCCUPANCY_COOLDOWN:
+        if (!motion && zclOccupancy_Settled) {
+            zclOccupancy_CooldownDone();
+        }
+        break;
+
+    default:
+        // BLIND, leftovers of the power down
+        break;
+    }
+}
+
+/*********************************************************************
+ * @fn      zclOccupancy_Process
+ * @brief   State timer, ends the current window
+ * @param   void
+ * @return  void
+ */
+void zclOccupancy_Process(void) {
+    uint32 left;
+
+    switch (zclOccupancy_State) {
+    case ZCL_OCCUPANCY_TRIGGERING:
+        // too few edges within UnoccupiedToOccupiedDelay
+        zclOccupancy_Enter(ZCL_OCCUPANCY_UNOCCUPIED, 0);
+        break;
+
+    case ZCL_OCCUPANCY_OCCUPIED:
+        left = zclOccupancy_HoldLeft();
+        if (left != 0) {
+            zclOccupancy_Enter(ZCL_OCCUPANCY_OCCUPIED, left);
+        } else {
+            zclOccupancy_Enter(ZCL_OCCUPANCY_UNOCCUPIED, 0);
+            zclOccupancy_Report(0);
+        }
+        break;
+
+    case ZCL_OCCUPANCY_BLIND:
+        zclOccupancy_Config->sensorPower(TRUE);
+        zclOccupancy_Settled = FALSE;
+        zclOccupancy_Enter(ZCL_OCCUPANCY_COOLDOWN, ZCL_OCCUPANCY_SETTLE_MS);
+        break;
+
+    case ZCL_OCCUPANCY_COOLDOWN:
+        if (!zclOccupancy_Settled && zclOccupancy_Motion) {
+            // the falling edge ends it, a stuck output one more settle time later
+            zclOccupancy_Settled = TRUE;
+            zclOccupancy_Enter(ZCL_OCCUPANCY_COOLDOWN, ZCL_OCCUPANCY_SETTLE_MS);
+        } else {
+            zclOccupancy_CooldownDone();
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+/*********************************************************************
+ * @fn      zclOccupancy_Enter
+ * @brief   Switches the state and arms the state timer
+ * @param   state - ZCL_OCCUPANCY_*
+ * @param   ms - state timer, 0 stops it
+ */
+static void zclOccupancy_Enter(uint8 state, uint32 ms) {
+    LREP("zclOccupancy %d -> %d for %ld ms\r\n", zclOccupancy_State, state, ms);
+    zclOccupancy_State = state;
+    if (ms != 0) {
+        osal_start_timerEx(zclOccupancy_TaskId, zclOccupancy_Event, ms);
+    } else {
+        osal_stop_timerEx(zclOccupancy_TaskId, zclOccupancy_Event);
+    }
+}
+
+/*********************************************************************
+ * @fn      zclOccupancy_Trigger
+ * @brief   Motion edge while unoccupied, the window of
+ *          UnoccupiedToOccupiedDelay starts with the first one
+ */
+static void zclOccupancy_Trigger(void) {
+    uint16 window = *zclOccupancy_Config->unoccupiedToOccupiedDelay;
+
+    zclOccupancy_Triggers++;
+    if (zclOccupancy_Triggers >= *zclOccupancy_Config->unoccupiedToOccupiedThreshold || window == 0) {
+        zclOccupancy_Report(1);
+        zclOccupancy_Hold();
+    } else if (zclOccupancy_State == ZCL_OCCUPANCY_UNOCCUPIED) {
+        zclOccupancy_Enter(ZCL_OCCUPANCY_TRIGGERING, (uint32)window * 1000);
+    }
+}
+
+/*********************************************************************
+ * @fn      zclOccupancy_Hold
+ * @brief   (Re)starts OccupiedToUnoccupiedDelay, the PIR sleeps through
+ *          the first part of it
+ */
+static void zclOccupancy_Hold(void) {
+    uint32 hold = (uint32)*zclOccupancy_Config->occupiedToUnoccupiedDelay * 1000;
+    uint32 blind = hold >> ZCL_OCCUPANCY_BLIND_SHIFT;
+
+    zclOccupancy_HoldEnd = osal_GetSystemClock() + hold;
+    if (zclOccupancy_Config->sensorPower != NULL && blind > ZCL_OCCUPANCY_SETTLE_MS) {
+        zclOccupancy_Config->sensorPower(FALSE);
+        zclOccupancy_Enter(ZCL_OCCUPANCY_BLIND, blind);
+    } else {
+        // a zero hold still ends through the timer
+        zclOccupancy_Enter(ZCL_OCCUPANCY_OCCUPIED, hold != 0 ? hold : 1);
+    }
+}
+
+/*********************************************************************
+ * @fn      zclOccupancy_CooldownDone
+ * @brief   PIR output is usable again, listen for the rest of the hold
+ */
+static void zclOccupancy_CooldownDone(void) {
+    uint32 left = zclOccupancy_HoldLeft();
+
+    if (*zclOccupancy_Config->occupancy && left != 0) {
+        zclOccupancy_Enter(ZCL_OCCUPANCY_OCCUPIED, left);
+    } else {
+        zclOccupancy_Enter(ZCL_OCCUPANCY_UNOCCUPIED, 0);
+        if (*zclOccupancy_Config->occupancy) {
+            zclOccupancy_Report(0);
+        }
+    }
+}
+
+static void zclOccupancy_Report(uint8 occupied) {
+    *zclOccupancy_Config->occupancy = occupied;
+    zclOccupancy_Config->report();
+}
+
+static uint32 zclOccupancy_HoldLeft(void) {
+    int32 left = (int32)(zclOccupancy_HoldEnd - osal_GetSystemClock());
+    return left > 0 ? (uint32)left : 0;
+}
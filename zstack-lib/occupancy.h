@@ -0,0 +1,58 @@
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+#include "hal_types.h"
+
+/*
+  Occupancy state machine of a PIR sensor, driven by the ZCL occupancy
+  sensing attributes.
+
+  UNOCCUPIED  PIR listens, a motion edge goes to TRIGGERING, or straight
+              to OCCUPIED with a threshold of 1
+  TRIGGERING  counts motion edges, UnoccupiedToOccupiedThreshold of them
+              within UnoccupiedToOccupiedDelay make it OCCUPIED, else back
+              to UNOCCUPIED without a report
+  OCCUPIED    PIR listens, motion only re-arms the OccupiedToUnoccupiedDelay
+              hold without a report, the hold running out reports
+              UNOCCUPIED
+  BLIND       PIR unpowered for the first part of the hold, motion can't
+              change anything there, so the sensor doesn't wake us up
+  COOLDOWN    PIR powered again, edges are ignored until its output settled
+              low, then OCCUPIED or UNOCCUPIED depending on the hold
+
+  Only the transitions to OCCUPIED and back are reported.
+*/
+
+#define ZCL_OCCUPANCY_UNOCCUPIED 0
+#define ZCL_OCCUPANCY_TRIGGERING 1
+#define ZCL_OCCUPANCY_OCCUPIED   2
+#define ZCL_OCCUPANCY_BLIND      3
+#define ZCL_OCCUPANCY_COOLDOWN   4
+
+// PIR output settling after power up, edges in between are ignored
+#ifndef ZCL_OCCUPANCY_SETTLE_MS
+#define ZCL_OCCUPANCY_SETTLE_MS 2000
+#endif
+
+// blind part of the hold, hold >> shift, shorter windows aren't worth the settling
+#ifndef ZCL_OCCUPANCY_BLIND_SHIFT
+#define ZCL_OCCUPANCY_BLIND_SHIFT 1
+#endif
+
+typedef struct {
+    uint8 *occupancy;                           // ZCL Occupancy attribute, bit 0
+    const uint16 *occupiedToUnoccupiedDelay;    // s, PIROccupiedToUnoccupiedDelay
+    const uint16 *unoccupiedToOccupiedDelay;    // s, PIRUnoccupiedToOccupiedDelay
+    const uint8 *unoccupiedToOccupiedThreshold; // motion edges, PIRUnoccupiedToOccupiedThreshold
+    void (*sensorPower)(bool on);               // may be NULL, then BLIND is skipped
+    void (*report)(void);                       // occupancy attribute changed
+    void (*rearm)(void);                        // hold restarted by motion, may be NULL
+} zclOccupancy_t;
+
+extern uint8 zclOccupancy_State;
+
+extern void zclOccupancy_Init(const zclOccupancy_t *config, uint8 taskId, uint16 event);
+extern void zclOccupancy_Edge(bool motion);
+extern void zclOccupancy_Process(void);
+
+#endif
@@ -0,0 +1,119 @@
+#include "reporting.h"
+
+#include "Debug.h"
+#include "OSAL.h"
+#include "bdb_interface.h"
+
+static const zclReportingEntry_t *zclReporting_Entries = NULL;
+static uint8 zclReporting_Count = 0;
+static uint32 zclReporting_Last[ZCL_REPORTING_MAX_ENTRIES]; // value last handed to the BDB
+
+static int8 zclReporting_Find(uint8 endpoint, uint16 cluster, uint16 attrId);
+
+/*********************************************************************
+ * @fn      zclReporting_Init
+ * @brief   Registers the default reporting configuration of every entry
+ *          with the BDB, call after the attribute lists are registered
+ * @param   entries - table, must stay valid
+ * @param   count - number of entries, up to ZCL_REPORTING_MAX_ENTRIES
+ * @return  void
+ */
+void zclReporting_Init(const zclReportingEntry_t *entries, uint8 count) {
+    uint8 change[4];
+    uint8 i;
+
+    if (count > ZCL_REPORTING_MAX_ENTRIES) {
+        LREP("zclReporting_Init %d entries, using %d\r\n", count, ZCL_REPORTING_MAX_ENTRIES);
+        count = ZCL_REPORTING_MAX_ENTRIES;
+    }
+    zclReporting_Entries = entries;
+    zclReporting_Count = count;
+    // first zclReporting_Process hands every attribute over
+    osal_memset(zclReporting_Last, 0xFF, sizeof(zclReporting_Last));
+
+    for (i = 0; i < count; i++) {
+        const zclReportingEntry_t *entry = &entries[i];
+        // little endian, as long as the attribute
+        change[0] = (uint8)entry->reportableChange;
+        change[1] = (uint8)(entry->reportableChange >> 8);
+        change[2] = (uint8)(entry->reportableChange >> 16);
+        change[3] = (uint8)(entry->reportableChange >> 24);
+        bdb_RepAddAttrCfgRecordDefaultToList(entry->endpoint, entry->cluster, entry->attrId, entry->minInterval,
+                                             entry->maxInterval, change);
+    }
+}
+
+/*********************************************************************
+ * @fn      zclReporting_Process
+ * @brief   Hands every attribute that changed since the last call to
+ *          the BDB, call after a measurement updated the attributes
+ * @param   void
+ * @return  number of changed attributes
+ */
+uint8 zclReporting_Process(void) {
+    uint8 changed = 0;
+    uint8 len;
+    uint8 i;
+
+    for (i = 0; i < zclReporting_Count; i++) {
+        const zclReportingEntry_t *entry = &zclReporting_Entries[i];
+        len = (uint8)zclGetDataTypeLength(entry->type);
+        if (len > sizeof(uint32) || osal_memcmp(entry->value, &zclReporting_Last[i], len)) {
+            continue;
+        }
+        osal_memcpy(&zclReporting_Last[i], entry->value, len);
+        changed++;
+        bdb_RepChangedAttrValue(entry->endpoint, entry->cluster, entry->attrId);
+    }
+    return changed;
+}
+
+/*********************************************************************
+ * @fn      zclReporting_SendNow
+ * @brief   Sends a Report Attributes frame with the single attribute to
+ *          the bindings without waiting for the BDB, the BDB is not told
+ *          about the change, so it does not repeat the frame
+ * @param   endpoint, cluster, attrId - table entry
+ * @return  ZSuccess once the frame is handed to AF
+ */
+ZStatus_t zclReporting_SendNow(uint8 endpoint, uint16 cluster, uint16 attrId) {
+    afAddrType_t inderect_DstAddr = {.addrMode = (afAddrMode_t)AddrNotPresent, .endPoint = 0, .addr.shortAddr = 0};
+    zclReportCmd_t *pReportCmd;
+    const zclReportingEntry_t *entry;
+    ZStatus_t status;
+    int8 i = zclReporting_Find(endpoint, cluster, attrId);
+
+    if (i < 0) {
+        return ZInvalidParameter;
+    }
+    entry = &zclReporting_Entries[i];
+    pReportCmd = osal_mem_alloc(sizeof(zclReportCmd_t) + sizeof(zclReport_t));
+    if (pReportCmd == NULL) {
+        return ZMemError;
+    }
+    pReportCmd->numAttr = 1;
+    pReportCmd->attrList[0].attrID = entry->attrId;
+    pReportCmd->attrList[0].dataType = entry->type;
+    pReportCmd->attrList[0].attrData = entry->value;
+    status = zcl_SendReportCmd(entry->endpoint, &inderect_DstAddr, entry->cluster, pReportCmd, ZCL_FRAME_SERVER_CLIENT_DIR,
+                               TRUE, bdb_getZCLFrameCounter());
+    osal_mem_free(pReportCmd);
+
+    if (status == ZSuccess) {
+        // zclReporting_Process won't hand the value over again
+        osal_memcpy(&zclReporting_Last[i], entry->value, zclGetDataTypeLength(entry->type));
+    }
+    return status;
+}
+
+static int8 zclReporting_Find(uint8 endpoint, uint16 cluster, uint16 attrId) {
+    uint8 i;
+
+    for (i = 0; i < zclReporting_Count; i++) {
+        const zclReportingEntry_t *entry = &zclReporting_Entries[i];
+        if (entry->endpoint == endpoint && entry->cluster == cluster && entry->attrId == attrId) {
+            return (int8)i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,40 @@
+#ifndef REPORTING_H
+#define REPORTING_H
+
+#include "zcl.h"
+
+/*
+  Change detection in front of the BDB reporting. Every attribute in the
+  table is handed to bdb_RepChangedAttrValue as soon as its value moved,
+  the BDB then applies the reportable change and min/max intervals the
+  coordinator configured (ZCL Configure Reporting). The table values are
+  the defaults until then.
+
+  The BDB already sends one Report Attributes frame per cluster with all
+  of its reportable attributes, so calling zclReporting_Process once at
+  the end of a measurement cycle is all the coalescing there is.
+
+  zclReporting_SendNow skips the BDB altogether for the latency critical
+  ones, e.g. occupancy straight from the PIR interrupt.
+*/
+
+#ifndef ZCL_REPORTING_MAX_ENTRIES
+#define ZCL_REPORTING_MAX_ENTRIES 12
+#endif
+
+typedef struct {
+    uint8 endpoint;
+    uint16 cluster;
+    uint16 attrId;
+    uint8 type;              // ZCL_DATATYPE_*, up to 4 bytes
+    void *value;             // same variable as in the attribute list
+    uint16 minInterval;      // s
+    uint16 maxInterval;      // s
+    uint32 reportableChange; // in attribute units, ignored by the BDB for discrete types
+} zclReportingEntry_t;
+
+extern void zclReporting_Init(const zclReportingEntry_t *entries, uint8 count);
+extern uint8 zclReporting_Process(void);
+extern ZStatus_t zclReporting_SendNow(uint8 endpoint, uint16 cluster, uint16 attrId);
+
+#endif
@@ -0,0 +1,113 @@
+#include "sampling.h"
+
+#include "Debug.h"
+#include "OSAL.h"
+
+#define ZCL_SAMPLING_ONE_STEP 16                         // EWMA fixed point, Q4 steps per cycle
+#define ZCL_SAMPLING_SHRINK (ZCL_SAMPLING_ONE_STEP / 2)  // half a step per cycle
+#define ZCL_SAMPLING_GROW (ZCL_SAMPLING_ONE_STEP / 8)    // an eighth of a step per cycle
+#define ZCL_SAMPLING_RATE_MAX (ZCL_SAMPLING_ONE_STEP * 8) // a jump doesn't outlast a few cycles
+
+typedef struct {
+    int32 last;
+    uint16 rate; // EWMA of |delta| / step, Q4
+    bool valid;
+} zclSamplingSignal_t;
+
+static zclSamplingSignal_t zclSampling_Signals[ZCL_SAMPLING_MAX_SIGNALS];
+static bool zclSampling_Active = FALSE; // activity since the last update
+
+uint16 zclSampling_Interval = 0;
+
+/*********************************************************************
+ * @fn      zclSampling_Init
+ * @brief   Forgets all signals and starts at the floor
+ * @param   floor - shortest interval, s
+ * @return  void
+ */
+void zclSampling_Init(uint16 floor) {
+    osal_memset(zclSampling_Signals, 0, sizeof(zclSampling_Signals));
+    zclSampling_Active = FALSE;
+    zclSampling_Interval = floor;
+}
+
+/*********************************************************************
+ * @fn      zclSampling_Track
+ * @brief   Folds the change since the previous reading into the signal rate
+ * @param   signal - index, below ZCL_SAMPLING_MAX_SIGNALS
+ * @param   value - reading in attribute units
+ * @param   step - change that counts as a movement, in the same units
+ * @return  void
+ */
+void zclSampling_Track(uint8 signal, int32 value, uint16 step) {
+    zclSamplingSignal_t *s;
+    uint32 delta;
+    uint16 rate;
+
+    if (signal >= ZCL_SAMPLING_MAX_SIGNALS || step == 0) {
+        return;
+    }
+    s = &zclSampling_Signals[signal];
+    if (!s->valid) {
+        // the first reading has nothing to compare with
+        s->last = value;
+        s->valid = TRUE;
+        return;
+    }
+    delta = (value > s->last) ? (uint32)(value - s->last) : (uint32)(s->last - value);
+    s->last = value;
+
+    rate = (delta >= (uint32)step * ZCL_SAMPLING_RATE_MAX / ZCL_SAMPLING_ONE_STEP)
+               ? ZCL_SAMPLING_RATE_MAX
+               : (uint16)(delta * ZCL_SAMPLING_ONE_STEP / step);
+    // alpha = 1/2, a reportable change shrinks the interval right away
+    s->rate = (s->rate >> 1) + (rate >> 1);
+}
+
+/*********************************************************************
+ * @fn      zclSampling_Activity
+ * @brief   Something happened around the device, measure at the floor
+ * @param   floor - shortest interval, s
+ * @return  void
+ */
+void zclSampling_Activity(uint16 floor) {
+    zclSampling_Active = TRUE;
+    zclSampling_Interval = floor;
+}
+
+/*********************************************************************
+ * @fn      zclSampling_Update
+ * @brief   Picks the next interval from the fastest moving signal, call
+ *          once per cycle after all readings are tracked
+ * @param   floor - shortest interval, s
+ * @param   ceiling - longest interval, s, up to 0xFFFF / 2
+ * @return  next interval, s
+ */
+uint16 zclSampling_Update(uint16 floor, uint16 ceiling) {
+    uint16 fastest = 0;
+    uint8 i;
+
+    for (i = 0; i < ZCL_SAMPLING_MAX_SIGNALS; i++) {
+        if (zclSampling_Signals[i].valid && zclSampling_Signals[i].rate > fastest) {
+            fastest = zclSampling_Signals[i].rate;
+        }
+    }
+
+    if (zclSampling_Active) {
+        // the cycle right after an event doesn't stretch yet
+        zclSampling_Active = FALSE;
+        zclSampling_Interval = floor;
+    } else if (fastest >= ZCL_SAMPLING_SHRINK) {
+        zclSampling_Interval >>= 1;
+    } else if (fastest < ZCL_SAMPLING_GROW) {
+        zclSampling_Interval += (zclSampling_Interval >> 1) + 1;
+    }
+    if (zclSampling_Interval < floor) {
+        zclSampling_Interval = floor;
+    }
+    if (zclSampling_Interval > ceiling) {
+        zclSampling_Interval = ceiling;
+    }
+    LREP("zclSampling_Update fastest=%d interval=%d\r\n", fastest, zclSampling_Interval);
+    return zclSampling_Interval;
+}
@@ -0,0 +1,27 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include "hal_types.h"
+
+/*
+  Adaptive measurement interval. Every cycle the application hands its
+  readings over, each signal keeps a short EWMA of its change per cycle
+  in units of a step (usually the reportable change of the attribute).
+
+  Signals moving by half a step or more halve the interval down to the
+  floor, signals below an eighth of a step stretch it by half up to the
+  ceiling. Events like occupancy or contact go straight to the floor.
+*/
+
+#ifndef ZCL_SAMPLING_MAX_SIGNALS
+#define ZCL_SAMPLING_MAX_SIGNALS 6
+#endif
+
+extern uint16 zclSampling_Interval; // s, until the next measurement
+
+extern void zclSampling_Init(uint16 floor);
+extern void zclSampling_Track(uint8 signal, int32 value, uint16 step);
+extern void zclSampling_Activity(uint16 floor);
+extern uint16 zclSampling_Update(uint16 floor, uint16 ceiling);
+
+#endif
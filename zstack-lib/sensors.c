@@ -0,0 +1,143 @@
+#include "sensors.h"
+
+#include "Debug.h"
+#include "OSAL.h"
+#include "OSAL_Clock.h"
+
+static const zclSensor_t *zclSensors_Table = NULL;
+static uint8 zclSensors_Count = 0;
+static uint8 zclSensors_TaskId;
+static uint16 zclSensors_Event;
+static void (*zclSensors_Done)(void) = NULL;
+
+static uint8 zclSensors_Probed = 0;  // bit per sensor
+static uint8 zclSensors_Present = 0;
+static uint8 zclSensors_Running = 0; // triggered in the current cycle
+static uint32 zclSensors_LastRun[ZCL_SENSORS_MAX]; // osal_getClock of the last read
+
+static bool zclSensors_Due(uint8 i, bool all);
+
+/*********************************************************************
+ * @fn      zclSensors_Init
+ * @brief   Takes the sensor table, nothing is probed until the first cycle
+ * @param   sensors - table, must stay valid
+ * @param   count - number of sensors, up to ZCL_SENSORS_MAX
+ * @param   taskId - task that gets the conversion done event
+ * @param   event - calls zclSensors_Process when it fires
+ * @param   done - called after every cycle, may be NULL
+ * @return  void
+ */
+void zclSensors_Init(const zclSensor_t *sensors, uint8 count, uint8 taskId, uint16 event, void (*done)(void)) {
+    if (count > ZCL_SENSORS_MAX) {
+        LREP("zclSensors_Init %d sensors, using %d\r\n", count, ZCL_SENSORS_MAX);
+        count = ZCL_SENSORS_MAX;
+    }
+    zclSensors_Table = sensors;
+    zclSensors_Count = count;
+    zclSensors_TaskId = taskId;
+    zclSensors_Event = event;
+    zclSensors_Done = done;
+    zclSensors_Probed = 0;
+    zclSensors_Present = 0;
+    zclSensors_Running = 0;
+    osal_memset(zclSensors_LastRun, 0, sizeof(zclSensors_LastRun));
+}
+
+/*********************************************************************
+ * @fn      zclSensors_Start
+ * @brief   Powers up and triggers all due sensors
+ * @param   all - ignore the periods, e.g. for a forced report
+ * @return  FALSE if the previous cycle is still running
+ */
+bool zclSensors_Start(bool all) {
+    const zclSensor_t *s;
+    uint16 wait = 0;
+    uint16 ms;
+    uint8 i;
+
+    if (zclSensors_Running) {
+        return FALSE;
+    }
+    for (i = 0; i < zclSensors_Count; i++) {
+        if (!zclSensors_Due(i, all)) {
+            continue;
+        }
+        s = &zclSensors_Table[i];
+        if (s->powerUp != NULL) {
+            s->powerUp();
+        }
+        if (s->trigger != NULL) {
+            s->trigger();
+        }
+        ms = (s->conversionMs != NULL) ? s->conversionMs() : 0;
+        if (ms > wait) {
+            wait = ms;
+        }
+        zclSensors_Running |= BV(i);
+    }
+    LREP("zclSensors_Start running=0x%X wait=%d\r\n", zclSensors_Running, wait);
+
+    if (wait > 0) {
+        // +1 ms covers the OSAL tick the timer is started in
+        osal_start_timerEx(zclSensors_TaskId, zclSensors_Event, wait + 1);
+    } else {
+        zclSensors_Process();
+    }
+    return TRUE;
+}
+
+/*********************************************************************
+ * @fn      zclSensors_Process
+ * @brief   Reads and powers down the sensors of the current cycle
+ * @param   void
+ * @return  void
+ */
+void zclSensors_Process(void) {
+    const zclSensor_t *s;
+    uint32 now = osal_getClock();
+    uint8 i;
+
+    for (i = 0; i < zclSensors_Count; i++) {
+        if (!(zclSensors_Running & BV(i))) {
+            continue;
+        }
+        s = &zclSensors_Table[i];
+        if (s->read != NULL) {
+            s->read();
+        }
+        if (s->powerDown != NULL) {
+            s->powerDown();
+        }
+        zclSensors_LastRun[i] = now;
+    }
+    zclSensors_Running = 0;
+    if (zclSensors_Done != NULL) {
+        zclSensors_Done();
+    }
+}
+
+/*********************************************************************
+ * @fn      zclSensors_Busy
+ * @brief   A cycle waits for its conversions
+ * @param   void
+ * @return  TRUE until zclSensors_Process has run
+ */
+bool zclSensors_Busy(void) { return zclSensors_Running != 0; }
+
+static bool zclSensors_Due(uint8 i, bool all) {
+    const zclSensor_t *s = &zclSensors_Table[i];
+
+    if (!(zclSensors_Probed & BV(i))) {
+        zclSensors_Probed |= BV(i);
+        if (s->probe == NULL || s->probe()) {
+            zclSensors_Present |= BV(i);
+            // due right away, whatever the period
+            return TRUE;
+        }
+        LREP("zclSensors sensor %d not present\r\n", i);
+    }
+    if (!(zclSensors_Present & BV(i))) {
+        return FALSE;
+    }
+    return all || s->period == 0 || (osal_getClock() - zclSensors_LastRun[i]) >= s->period;
+}
@@ -0,0 +1,37 @@
+#ifndef SENSORS_H
+#define SENSORS_H
+
+#include "hal_types.h"
+
+/*
+  Measurement cycle over a table of sensor descriptors.
+
+  zclSensors_Start probes sensors on their first cycle, then powers up and
+  triggers every due sensor at once. The conversions overlap, the task
+  event fires after the longest of them and zclSensors_Process reads and
+  powers down all triggered sensors in table order. A sensor without a
+  conversion is read in the same pass.
+
+  Every callback may be NULL.
+*/
+
+#ifndef ZCL_SENSORS_MAX
+#define ZCL_SENSORS_MAX 8 // bit per sensor in a uint8
+#endif
+
+typedef struct {
+    bool (*probe)(void);          // once, FALSE drops the sensor
+    void (*powerUp)(void);
+    void (*trigger)(void);        // starts the conversion
+    uint16 (*conversionMs)(void); // after the trigger, time until the result can be read
+    void (*read)(void);           // fetches and publishes the result
+    void (*powerDown)(void);
+    uint16 period;                // s, 0 - every cycle
+} zclSensor_t;
+
+extern void zclSensors_Init(const zclSensor_t *sensors, uint8 count, uint8 taskId, uint16 event, void (*done)(void));
+extern bool zclSensors_Start(bool all);
+extern void zclSensors_Process(void);
+extern bool zclSensors_Busy(void);
+
+#endif
@@ -1,5 +1,6 @@
 #include "utils.h"
 #include "hal_adc.h"
+#include "hal_adc_dma.h"
 
 // #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 // #define MIN(x, y) (((x) < (y)) ? (x) : (y))
@@ -9,11 +10,69 @@ double mapRange(double a1, double a2, double b1, double b2, double s) {
     return MIN(b2, MAX(result, b1));
 }
 
-uint16 adcReadSampled(uint8 channel, uint8 resolution, uint8 reference, uint8 samplesCount) {
-    HalAdcSetReference(reference);
+uint16 adcReadSampled(uint8 channel, uint8 resolution, uint8 reference, uint8 samplesCount, uint8 reducer) {
+    uint16 samples[HAL_ADC_DMA_SAMPLES_MAX];
     uint32 samplesSum = 0;
-    for (uint8 i = 0; i < samplesCount; i++) {
-        samplesSum += HalAdcRead(channel, resolution);
+    uint8 first = 0, last;
+    uint8 i, j;
+
+    samplesCount = MAX(1, MIN(samplesCount, HAL_ADC_DMA_SAMPLES_MAX));
+    last = samplesCount;
+    HalAdcDmaSample(channel, resolution, reference, samples, samplesCount);
+
+    if (reducer != ADC_REDUCE_MEAN) {
+        // insertion sort, a handful of samples
+        for (i = 1; i < samplesCount; i++) {
+            uint16 sample = samples[i];
+            for (j = i; j > 0 && samples[j - 1] > sample; j--) {
+                samples[j] = samples[j - 1];
+            }
+            samples[j] = sample;
+        }
+        if (reducer == ADC_REDUCE_MEDIAN) {
+            return (samplesCount & 0x01) ? samples[samplesCount >> 1]
+                                         : (samples[(samplesCount >> 1) - 1] + samples[samplesCount >> 1]) >> 1;
+        }
+        first = samplesCount >> 2;
+        last = samplesCount - first;
+    }
+    for (i = first; i < last; i++) {
+        samplesSum += samples[i];
+    }
+    return (uint16)(samplesSum / (last - first));
+}
+
+// log2(1 + i / 16) in Q12, i = 0..16
+static const uint16 log2Q12Table[17] = {
+    0,    358,  696,  1016, 1319, 1607, 1882, 2145, 2396,
+    2637, 2869, 3092, 3307, 3514, 3715, 3908, 4096};
+
+uint32 log2Q12(uint32 value) {
+    uint8 exponent = 31;
+    uint16 mantissa;
+    uint8 index;
+
+    if (value == 0) {
+        return 0;
+    }
+    while (!(value & 0x80000000UL)) {
+        value <<= 1;
+        exponent--;
+    }
+    // 15 bits below the leading one, the top 4 pick the table entry, the rest interpolates
+    mantissa = (uint16)(value >> 16) & 0x7FFF;
+    index = mantissa >> 11;
+    return ((uint32)exponent << 12) + log2Q12Table[index] +
+           (((uint32)(log2Q12Table[index + 1] - log2Q12Table[index]) * (mantissa & 0x7FF)) >> 11);
+}
+
+uint16 luxToZclIlluminance(uint32 luxQ8) {
+    uint32 log2Lux;
+
+    if (luxQ8 < ((uint32)1 << 8)) {
+        return 0; // below 1 lx, too low to be measured
     }
-    return samplesSum /samplesCount;
+    // log10(2) = 0.30103, drop the Q8 of the input
+    log2Lux = ((log2Q12(luxQ8) - ((uint32)8 << 12)) * 30103) / 40960 + 1;
+    return log2Lux > 0xFFFE ? 0xFFFE : (uint16)log2Lux;
 }
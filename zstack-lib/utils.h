@@ -2,7 +2,18 @@
 #define UTILS_H
 extern double mapRange(double a1, double a2, double b1, double b2, double s);
 
-extern uint16 adcReadSampled(uint8 channel, uint8 resolution, uint8 reference, uint8 samplesCount);
+// adcReadSampled reducers
+#define ADC_REDUCE_MEAN    0
+#define ADC_REDUCE_MEDIAN  1
+#define ADC_REDUCE_TRIMMED 2 // mean without the lowest and highest quarter
+
+extern uint16 adcReadSampled(uint8 channel, uint8 resolution, uint8 reference, uint8 samplesCount, uint8 reducer);
+
+// log2(value) in Q12, 0 for 0, max error 0.0004
+extern uint32 log2Q12(uint32 value);
+
+// ZCL illuminance MeasuredValue = 10000 * log10(lux) + 1, lux in 1/256 lx
+extern uint16 luxToZclIlluminance(uint32 luxQ8);
 
 
 #undef P
@@ -0,0 +1,159 @@
+#include "wake.h"
+
+#include "Debug.h"
+#include "OSAL.h"
+#include "OSAL_Timers.h"
+
+#define ZCL_WAKE_HOUR_MS ((uint32)3600000)
+
+static const zclWakeItem_t *zclWake_Items = NULL;
+static uint8 zclWake_Count = 0;
+static uint8 zclWake_TaskId;
+static uint16 zclWake_Event;
+
+static uint8 zclWake_Armed = 0; // bit per item
+static uint32 zclWake_Deadline[ZCL_WAKE_MAX_ITEMS]; // osal_GetSystemClock ms
+static uint32 zclWake_HourStart = 0;
+static uint16 zclWake_ThisHour = 0;
+
+uint16 zclWake_PerHour = 0;
+
+static void zclWake_Arm(void);
+
+/*********************************************************************
+ * @fn      zclWake_Init
+ * @brief   Takes the item table and arms the periodic items
+ * @param   items - table, must stay valid
+ * @param   count - number of items, up to ZCL_WAKE_MAX_ITEMS
+ * @param   taskId - task of the item events and the wake timer
+ * @param   event - wake timer, calls zclWake_Process when it fires
+ * @return  void
+ */
+void zclWake_Init(const zclWakeItem_t *items, uint8 count, uint8 taskId, uint16 event) {
+    uint32 now = osal_GetSystemClock();
+    uint8 i;
+
+    if (count > ZCL_WAKE_MAX_ITEMS) {
+        LREP("zclWake_Init %d items, using %d\r\n", count, ZCL_WAKE_MAX_ITEMS);
+        count = ZCL_WAKE_MAX_ITEMS;
+    }
+    zclWake_Items = items;
+    zclWake_Count = count;
+    zclWake_TaskId = taskId;
+    zclWake_Event = event;
+    zclWake_Armed = 0;
+    zclWake_HourStart = now;
+    zclWake_ThisHour = 0;
+
+    for (i = 0; i < count; i++) {
+        if (items[i].period != 0) {
+            zclWake_Deadline[i] = now + items[i].period;
+            zclWake_Armed |= BV(i);
+        }
+    }
+    zclWake_Arm();
+}
+
+/*********************************************************************
+ * @fn      zclWake_Schedule
+ * @brief   Moves the next deadline of an item, periodic items continue
+ *          their cadence from there
+ * @param   item - index in the table
+ * @param   ms - from now
+ * @return  void
+ */
+void zclWake_Schedule(uint8 item, uint32 ms) {
+    if (item >= zclWake_Count) {
+        return;
+    }
+    zclWake_Deadline[item] = osal_GetSystemClock() + ms;
+    zclWake_Armed |= BV(item);
+    zclWake_Arm();
+}
+
+/*********************************************************************
+ * @fn      zclWake_Remaining
+ * @brief   Time until the deadline of an item
+ * @param   item - index in the table
+ * @return  ms, 0 if the item isn't armed or already due
+ */
+uint32 zclWake_Remaining(uint8 item) {
+    int32 left;
+
+    if (item >= zclWake_Count || !(zclWake_Armed & BV(item))) {
+        return 0;
+    }
+    left = (int32)(zclWake_Deadline[item] - osal_GetSystemClock());
+    return left > 0 ? (uint32)left : 0;
+}
+
+/*********************************************************************
+ * @fn      zclWake_Process
+ * @brief   Sets the events of all items within their slack and arms
+ *          the timer for the next deadline
+ * @param   void
+ * @return  void
+ */
+void zclWake_Process(void) {
+    uint32 now = osal_GetSystemClock();
+    uint8 ran = 0;
+    uint8 i;
+
+    for (i = 0; i < zclWake_Count; i++) {
+        if (!(zclWake_Armed & BV(i)) || (int32)(zclWake_Deadline[i] - now) > (int32)zclWake_Items[i].slack) {
+            continue;
+        }
+        osal_set_event(zclWake_TaskId, zclWake_Items[i].event);
+        ran |= BV(i);
+        if (zclWake_Items[i].period == 0) {
+            zclWake_Armed &= ~BV(i);
+        } else {
+            zclWake_Deadline[i] += zclWake_Items[i].period;
+            if ((int32)(zclWake_Deadline[i] - now) <= 0) {
+                // missed a whole period, e.g. while commissioning
+                zclWake_Deadline[i] = now + zclWake_Items[i].period;
+            }
+        }
+    }
+
+    if (ran) {
+        zclWake_ThisHour++;
+    }
+    if (now - zclWake_HourStart >= ZCL_WAKE_HOUR_MS) {
+        zclWake_PerHour = zclWake_ThisHour;
+        zclWake_ThisHour = 0;
+        zclWake_HourStart = now;
+    }
+    LREP("zclWake_Process ran=0x%X this hour=%d\r\n", ran, zclWake_ThisHour);
+    zclWake_Arm();
+}
+
+static void zclWake_Arm(void) {
+    uint32 now = osal_GetSystemClock();
+    uint32 next = 0xFFFFFFFF;
+    int32 left;
+    uint8 i;
+
+    for (i = 0; i < zclWake_Count; i++) {
+        if (!(zclWake_Armed & BV(i))) {
+            continue;
+        }
+        left = (int32)(zclWake_Deadline[i] - now);
+        if (left <= 0) {
+            next = 0;
+            break;
+        }
+        if ((uint32)left < next) {
+            next = (uint32)left;
+        }
+    }
+
+    if (next == 0xFFFFFFFF) {
+        osal_stop_timerEx(zclWake_TaskId, zclWake_Event);
+    } else if (next == 0) {
+        osal_stop_timerEx(zclWake_TaskId, zclWake_Event);
+        osal_set_event(zclWake_TaskId, zclWake_Event);
+    } else {
+        osal_start_timerEx(zclWake_TaskId, zclWake_Event, next);
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef WAKE_H
+#define WAKE_H
+
+#include "hal_types.h"
+
+/*
+  One timer for all periodic work of a task. Every item is an event of
+  that task with a deadline, the timer fires at the earliest deadline and
+  every item within its slack of its own deadline runs in the same
+  wakeup, a little early rather than waking the device once more.
+
+  Periodic items keep their cadence, one shot items are armed again with
+  zclWake_Schedule.
+*/
+
+#ifndef ZCL_WAKE_MAX_ITEMS
+#define ZCL_WAKE_MAX_ITEMS 8 // bit per item in a uint8
+#endif
+
+typedef struct {
+    uint16 event;  // set on the task given to zclWake_Init
+    uint32 period; // ms, 0 - one shot
+    uint32 slack;  // ms the item may run early to share a wakeup
+} zclWakeItem_t;
+
+extern uint16 zclWake_PerHour; // wakeups in the last full hour
+
+extern void zclWake_Init(const zclWakeItem_t *items, uint8 count, uint8 taskId, uint16 event);
+extern void zclWake_Schedule(uint8 item, uint32 ms);
+extern uint32 zclWake_Remaining(uint8 item);
+extern void zclWake_Process(void);
+
+#endif